@@ -4,11 +4,18 @@
 #include "Commons/color.hpp"
 #include "Commons/conversions.hpp"
 #include "Commons/env.hpp"
+#include "Commons/lockfree.hpp"
 #include "Commons/log.hpp"
+#include "Commons/binlog.hpp"
+#include "Commons/logsink.hpp"
 #include "Commons/pointers.hpp"
 #include "Commons/time.hpp"
+#include "Commons/ThreadPool.hpp"
+#include "Commons/Task.hpp"
+#include "Commons/parallel.hpp"
 #include "Commons/Base.hpp"
 #include "Commons/Async.hpp"
+#include "Commons/Coroutine.hpp"
 #include "Commons/Command.hpp"
 #include "Commons/Observer.hpp"
 #include "Commons/eventList.hpp"
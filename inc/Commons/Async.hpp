@@ -4,15 +4,17 @@
 #include "_includes.hpp"
 #include "log.hpp"
 #include "Observer.hpp"
+#include "ThreadPool.hpp"
+#include "Task.hpp"
 
 /** @file
- *  Defines SSS::Async class.
+ *  Defines SSS::Async class, and SSS::asyncMetrics() function.
  */
 
 /** Used internally in SSS::Async.*/
 #define CATCH_ASYNCBASE_ERROR \
 catch (std::exception const& e) { \
-    _running_state = _RunningState::handled; \
+    _setState(_RunningState::handled); \
     LOG_CTX_ERR(CONTEXT_MSG(THIS_NAME, "Exception was caught"), e.what()); \
 };
 
@@ -25,19 +27,96 @@ namespace Log {
         using LOG_STRUCT_BASICS(Log, Async);
         /** \endcond*/
         /** Logs both constructor and destructor.*/
-        bool life_state = false;
+        Flag life_state = false;
         /** Logs when the functions starts, ends, and is handled.*/
-        bool run_state = false;
+        Flag run_state = false;
     };
 }
 
 template <class...>
 class Async;
+template <class, class...>
+class AsyncResult;
 
+/** Handles all completed SSS::Async functions, notifying their observers.
+ *  Meant to be called once per frame from the main thread.
+ */
 SSS_COMMONS_API void pollAsync();
+/** Handles completed SSS::Async functions until the given time budget
+ *  is used up. Completions left over are handled first on the next call.
+ *  At least one completion is handled per call, if any.
+ *  @param[in] budget The time after which no completion is handled anymore.
+ *  @return The number of completions left over.
+ */
+SSS_COMMONS_API std::size_t pollAsync(std::chrono::nanoseconds budget);
+
+/** Metrics of all SSS::Async instances of a given type,
+ *  with durations in nanoseconds.
+ *  @sa asyncMetrics()
+ */
+struct AsyncMetrics {
+    /** Readable name of the type, see SSS::typeName().*/
+    std::string_view type;
+    /** Runs started by a worker, canceled or not.*/
+    std::uint64_t runs{ 0 };
+    /** Runs which were canceled or superseded.*/
+    std::uint64_t canceled{ 0 };
+    /** Runs which threw an exception.*/
+    std::uint64_t exceptions{ 0 };
+    /** Time from run() to the function starting on a worker.*/
+    Histogram::Snapshot queue_latency;
+    /** Time the function ran for.*/
+    Histogram::Snapshot run_time;
+    /** Time from the function ending to pollAsync() handling it.*/
+    Histogram::Snapshot pending_time;
+    /** Time spent blocked in cancel(), including via run(). Calls
+     *  which found no function running aren't recorded.
+     */
+    Histogram::Snapshot cancel_wait;
+
+    /** Returns the ratio of canceled runs.*/
+    inline double cancelRate() const noexcept {
+        return runs == 0 ? 0.0 : static_cast<double>(canceled) / static_cast<double>(runs);
+    };
+    /** Returns the ratio of runs which threw.*/
+    inline double exceptionRate() const noexcept {
+        return runs == 0 ? 0.0 : static_cast<double>(exceptions) / static_cast<double>(runs);
+    };
+};
+
+/** Returns the metrics of each SSS::Async type which ran at least once
+ *  while metrics were enabled, sorted by type name.
+ *  @sa enableAsyncMetrics(), resetAsyncMetrics()
+ */
+SSS_COMMONS_API std::vector<AsyncMetrics> asyncMetrics();
+/** Forgets all recorded SSS::Async metrics.*/
+SSS_COMMONS_API void resetAsyncMetrics() noexcept;
+/** Enables or disables the recording of SSS::Async metrics, which costs
+ *  a few clock reads and relaxed atomic operations per run.
+ *  Enabled by default.
+ */
+SSS_COMMONS_API void enableAsyncMetrics(bool enabled) noexcept;
+/** Returns \c true if SSS::Async metrics are recorded.*/
+SSS_COMMONS_API bool asyncMetricsEnabled() noexcept;
 
 INTERNAL_BEGIN;
 
+// Resumes the given coroutine from the next pollAsync(), see SSS::nextPoll()
+SSS_COMMONS_API void resumeOnPoll(std::coroutine_handle<> handle);
+// Forgets the given coroutine if not resumed yet, as it is being destroyed
+SSS_COMMONS_API void cancelResumeOnPoll(std::coroutine_handle<> handle) noexcept;
+
+// Metrics shared by all instances of a SSS::Async type
+struct AsyncTypeMetrics {
+    Histogram queue_latency;
+    Histogram run_time;
+    Histogram pending_time;
+    Histogram cancel_wait;
+    std::atomic<std::uint64_t> runs{ 0 };
+    std::atomic<std::uint64_t> canceled{ 0 };
+    std::atomic<std::uint64_t> exceptions{ 0 };
+};
+
 // Ignore warning about STL exports as they're private members
 #pragma warning(push, 2)
 #pragma warning(disable: 4251)
@@ -46,12 +125,23 @@ INTERNAL_BEGIN;
 class SSS_COMMONS_API AsyncBase : public Subject {
     template <class...>
     friend class ::SSS::Async;
+    template <class, class...>
+    friend class ::SSS::AsyncResult;
     friend void ::SSS::pollAsync();
+    friend std::size_t SSS::pollAsync(std::chrono::nanoseconds);
 public:
     using Ref = std::reference_wrapper<AsyncBase>;
 private:
-    static std::set<Ref> _pending;
-    static std::mutex _mutex;
+    // Lock-free stack of completed instances, pushed by
+    // workers and moved to the carry-over list when polled
+    static std::atomic<AsyncBase*> _completed;
+    // Completed instances in FIFO order, guarded by _poll_mutex
+    static AsyncBase* _carry_head;
+    static AsyncBase* _carry_tail;
+    static std::mutex _poll_mutex;
+    // Instances with a trailing run to start, see Restart::coalesce
+    static std::vector<AsyncBase*> _armed;
+    static std::mutex _armed_mutex;
 public:
     AsyncBase();
     AsyncBase(AsyncBase&&) = delete;
@@ -62,17 +152,112 @@ public:
      *  In order for this function to work as intented, you should
      *  call _beingCanceled() as often as possible in your
      *  implementation of _asyncFunction(), and return
-     *  prematurely if it returns \c true.
+     *  prematurely if it returns \c true.\n
+     *  A run still queued on the executor is dropped without waiting
+     *  for a worker. A started run is waited for, which is safe from
+     *  workers too, but not from within _asyncFunction() itself.
      *  @sa run()
      */
     void cancel() noexcept;
+    /** Flags the running async function as canceled, and returns
+     *  without waiting for it. Its result will be discarded: it
+     *  won't be pending, nor notify observers.
+     *  @sa cancel(), Restart::detach
+     */
+    void requestCancel() noexcept;
 
+    /** What run() does with a function which is still running.*/
+    enum class Restart {
+        /** cancel() is called, blocking until the function returns.*/
+        wait,
+        /** The function is flagged as canceled and left to finish
+         *  in the background, while the new run starts right away
+         *  (latest wins). Its result is discarded.
+         */
+        detach,
+        /** The function is left to finish and be handled, and the
+         *  call is deferred. Calls made while a run is in flight, or
+         *  within the coalescing window after a run started, collapse
+         *  into a single trailing run with the latest arguments,
+         *  started from pollAsync(). cancel() and requestCancel()
+     *  drop the trailing run.
+         *  @sa setCoalesceWindow(), coalescedCount()
+         */
+        coalesce
+    };
+    /** Sets what run() does with a function which is still running.
+     *  Defaults to Restart::wait.
+     */
+    inline void setRestart(Restart mode) noexcept { _restart_mode = mode; };
+    /** Returns what run() does with a function which is still running.*/
+    inline Restart getRestart() const noexcept { return _restart_mode; };
+    /** Sets the minimum time between two run starts with
+     *  Restart::coalesce. Defaults to 0, only coalescing
+     *  calls made while a run is in flight.
+     */
+    inline void setCoalesceWindow(std::chrono::milliseconds window) noexcept { _coalesce_window = window; };
+    /** Returns the coalescing window, see setCoalesceWindow().*/
+    inline std::chrono::milliseconds getCoalesceWindow() const noexcept { return _coalesce_window; };
+    /** Returns the number of run() calls whose arguments were
+     *  replaced by a later call before running, see Restart::coalesce.
+     */
+    inline std::uint64_t coalescedCount() const noexcept {
+        return _coalesced_count.load(std::memory_order_relaxed);
+    };
 
     /** Returns \c true if the async function is currently running.
      *  An async function can either be running, pending, or handled.
      */
     bool isRunning() const noexcept;
 
+    /** Sets the pool run() submits to for this instance, overriding
+     *  the default executor. \c nullptr has run() use \c std::async,
+     *  creating a new thread for each run.\n
+     *  Should not be called while run() is being called.
+     *  @sa resetExecutor(), setDefaultExecutor()
+     */
+    void setExecutor(ThreadPool* pool) noexcept;
+    /** Has run() use the default executor again.
+     *  @sa setExecutor()
+     */
+    void resetExecutor() noexcept;
+
+    /** Sets the pool run() submits to for all instances without
+     *  their own executor. Defaults to ThreadPool::shared().\n
+     *  \c nullptr has run() use \c std::async, creating a new
+     *  thread for each run (the former behavior).\n
+     *  No benchmark compares both, the \c queue_latency of
+     *  asyncMetrics() being the way to measure either.
+     *  @sa setExecutor()
+     */
+    static void setDefaultExecutor(ThreadPool* pool) noexcept;
+    /** Returns the default executor, \c nullptr meaning \c std::async.*/
+    static ThreadPool* getDefaultExecutor() noexcept;
+
+    /** Sets the priority class of the next runs on the executor.
+     *  Defaults to Priority::normal.
+     *  @sa ThreadPool::submit()
+     */
+    inline void setPriority(Priority priority) noexcept { _priority = priority; };
+    /** Returns the priority class of runs, see setPriority().*/
+    inline Priority getPriority() const noexcept { return _priority; };
+    /** Sets how long after run() is called the function should
+     *  have started, zero meaning no deadline (the default).
+     *  @sa ThreadPool::submit()
+     */
+    inline void setDeadline(std::chrono::nanoseconds delay) noexcept { _deadline = delay; };
+    /** Returns the deadline delay of runs, see setDeadline().*/
+    inline std::chrono::nanoseconds getDeadline() const noexcept { return _deadline; };
+
+    /** Returns a task completing once the latest run() ended, whether
+     *  it succeeded, threw, or was canceled.\n
+     *  Continuations chained with Task::then() run on the executor's
+     *  workers right away, without waiting for pollAsync(). Observers
+     *  are still notified from pollAsync() as usual.
+     *  @return An invalid task if run() was never called.
+     */
+    Task<> completion() const noexcept;
+
 protected:
     /** To be called from your own implementation of
      *  _asyncFunction() as often as possible.
@@ -80,28 +265,211 @@ protected:
      *  call this function as often as possible in your
      *  implementation of _asyncFunction(), and return
      *  prematurely if it returns \c true.
-     *  @return \c true if cancel() was called but the async function
-     *  is still running, and \c false otherwise.
+     *  @return \c true if cancel() was called or the run was superseded
+     *  (see Restart::detach) but the async function is still running,
+     *  and \c false otherwise.
      */
     bool _beingCanceled() const noexcept;
 
+    /** Called from pollAsync() once the function was handled and
+     *  observers were notified. This is the last access to the
+     *  instance from pollAsync(), so overrides may destroy it.
+     */
+    virtual void _handled() noexcept {};
+    /** Called instead of _handled() when a run requested via run() ends
+     *  without being handled: canceled, superseded, dropped while queued
+     *  or coalesced, or failing to launch. Called at most once per run,
+     *  from the thread doing so, but not for runs canceled on destruction.
+     *  Runs whose function threw are neither handled nor dropped.
+     *  @param[in] error The exception which prevented the run from
+     *  launching, if any.
+     */
+    virtual void _dropped(std::exception_ptr error) noexcept {};
+
 private:
-    static void _poll() noexcept;
-    void _postRun() noexcept;
+    static std::size_t _poll(std::chrono::nanoseconds budget) noexcept;
+    // Moves _completed to the carry-over list, _poll_mutex should be locked
+    static void _collect() noexcept;
+    void _postRun(std::uint64_t generation) noexcept;
     void _handle() noexcept;
+    // Called from _handle() before notifying observers, so that
+    // derived classes keep the result of the run being handled
+    virtual void _claimResult() noexcept {};
+    void _caught(std::uint64_t generation, std::exception const& e) noexcept;
+
+    // Cancels or detaches the previous run, and returns the new generation
+    std::uint64_t _restart();
+    // Drops the latest run if no worker started it yet, completing it
+    // and resetting _future. Returns true if dropped.
+    bool _dropQueued() noexcept;
+    // Returns true if the latest run can't be handled once superseded,
+    // in which case _dropped() should be called
+    bool _unhandled() const noexcept;
+
+    // Returns true if run() should be deferred, see Restart::coalesce
+    bool _coalescing() const noexcept;
+    // Sets the trailing run, calling run() again with the latest arguments
+    void _defer(Job trailing) noexcept;
+    // Drops the trailing run, if any
+    void _dropTrailing() noexcept;
+    // Starts trailing runs which are due, from pollAsync()
+    static void _startTrailing() noexcept;
+
+    // Run being executed by the calling thread, for _beingCanceled()
+    struct _CurrentRun {
+        AsyncBase const* self;
+        std::uint64_t generation;
+    };
+    // Sets the current run of the calling thread, and returns the previous one
+    static _CurrentRun _swapCurrentRun(_CurrentRun run) noexcept;
+
+    // Returns the pool to submit to, nullptr meaning std::async
+    ThreadPool* _getExecutor() const noexcept;
+    // Returns the deadline of a run starting now
+    ThreadPool::Clock::time_point _runDeadline() const noexcept;
+    // Returns the metrics of this instance's type, nullptr if disabled
+    AsyncTypeMetrics* _getMetrics() noexcept;
+    // Returns the given duration in ns, for metrics
+    static std::uint64_t _elapsed(std::chrono::steady_clock::time_point since) noexcept;
+
+    // Starts a new run of the given body on the executor
+    template <class F>
+    void _launch(F&& body) noexcept try
+    {
+        std::uint64_t const generation = _restart();
+        _last_start = std::chrono::steady_clock::now();
+        ThreadPool* const pool = _getExecutor();
+        _newCompletion(pool);
+        auto claimed = std::make_shared<std::atomic<bool>>(false);
+        _claimed = claimed;
+        auto func = [this, generation, done = _completion, claimed = std::move(claimed),
+            metrics = _getMetrics(), submitted = _last_start, body = std::forward<F>(body)]() mutable
+        {
+            // Dropped while queued, see _dropQueued()
+            if (claimed->exchange(true)) {
+                return;
+            }
+            if (metrics != nullptr) {
+                metrics->queue_latency.record(_elapsed(submitted));
+            }
+            _execute(generation, body, metrics);
+            done->setValue();
+        };
+        if (pool != nullptr) {
+            std::packaged_task<void()> task(std::move(func));
+            _future = task.get_future();
+            pool->submit(std::move(task), _priority, _runDeadline());
+        }
+        else {
+            _future = std::async(std::launch::async, std::move(func));
+        }
+    }
+    catch (std::exception const& e) {
+        _launchFailed(e);
+    };
+    // Completes the run's task with the exception which
+    // prevented it from starting, so that nothing waits for it
+    void _launchFailed(std::exception const& e) noexcept;
+
+    // Calls the body of a run and sets _run_state accordingly
+    template <class F>
+    void _execute(std::uint64_t generation, F& body, AsyncTypeMetrics* metrics) noexcept
+    {
+        _CurrentRun const previous = _swapCurrentRun({ this, generation });
+        auto const start = std::chrono::steady_clock::now();
+        try {
+            LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Function started running.");
+
+            if (!_beingCanceled()) {
+                body();
+                _postRun(generation);
+            }
+        }
+        catch (std::exception const& e) {
+            if (metrics != nullptr) {
+                metrics->exceptions.fetch_add(1, std::memory_order_relaxed);
+            }
+            _caught(generation, e);
+        }
+        if (metrics != nullptr) {
+            metrics->run_time.record(_elapsed(start));
+            metrics->runs.fetch_add(1, std::memory_order_relaxed);
+            if (_beingCanceled()) {
+                metrics->canceled.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        _swapCurrentRun(previous);
+    };
+
+    // Set via setExecutor()
+    ThreadPool* _executor{ nullptr };
+    bool _has_executor{ false };
+
+    // Set via setDefaultExecutor(), null meaning ThreadPool::shared()
+    static std::atomic<ThreadPool*> _default_executor;
+    static std::atomic<bool> _default_std_async;
+
+    // Set via setPriority() and setDeadline()
+    Priority _priority{ Priority::normal };
+    std::chrono::nanoseconds _deadline{ 0 };
+
+    // Creates the completion state of a new run
+    void _newCompletion(ThreadPool* pool);
 
     // Created in run()
     std::future<void> _future;
+    // Claimed first by the worker starting the latest run, or by
+    // _dropQueued(), so that queued runs needn't be waited for
+    std::shared_ptr<std::atomic<bool>> _claimed;
+    std::shared_ptr<TaskState<void>> _completion;
+    // Superseded runs still executing, waited for by cancel()
+    std::vector<std::future<void>> _detached;
+    Restart _restart_mode{ Restart::wait };
+
+    // See Restart::coalesce, _trailing being guarded by _armed_mutex
+    std::chrono::milliseconds _coalesce_window{ 0 };
+    std::chrono::steady_clock::time_point _last_start;
+    Job _trailing;
+    std::atomic<std::uint64_t> _coalesced_count{ 0 };
 
     // Handled by cancel()
     std::atomic<bool> _is_canceled{ false };
 
-    enum class _RunningState {
+    // Set on first run, see _getMetrics()
+    std::atomic<AsyncTypeMetrics*> _metrics{ nullptr };
+    // Time the function became pending, in ns since the steady clock's epoch
+    std::atomic<long long> _pending_since{ 0 };
+
+    // Intrusive node of the completion queue
+    AsyncBase* _next{ nullptr };
+    std::atomic<bool> _in_queue{ false };
+    // Set while observers are notified, see _unhandled()
+    bool _handling{ false };
+
+    enum class _RunningState : std::uint64_t {
         handled,
         running,
         pending
     };
-    std::atomic<_RunningState> _running_state{ _RunningState::handled };
+    // Running state in the 2 low bits, and generation in the others.
+    // The generation is incremented by each run and cancelation, so
+    // that results of stale runs are dropped with a single CAS.
+    std::atomic<std::uint64_t> _run_state{ 0 };
+
+    static constexpr std::uint64_t _state_mask = 3;
+    static inline _RunningState _stateOf(std::uint64_t word) noexcept {
+        return static_cast<_RunningState>(word & _state_mask);
+    };
+    static inline std::uint64_t _generationOf(std::uint64_t word) noexcept {
+        return word >> 2;
+    };
+    static inline std::uint64_t _word(std::uint64_t generation, _RunningState state) noexcept {
+        return generation << 2 | static_cast<std::uint64_t>(state);
+    };
+    // Sets the running state, keeping the generation
+    void _setState(_RunningState state) noexcept;
+    // Increments the generation and sets the running state, returns the new generation
+    std::uint64_t _nextGeneration(_RunningState state) noexcept;
 };
 
 #pragma warning(pop)
@@ -124,17 +492,25 @@ class Async : public _internal::AsyncBase{
 public:
     /** Runs user defined _asyncFunction() with given arguments.
      *  Ensures that no async function overlaps by calling
-     *  cancel() beforehand.\n
-     *  Automatically updates the function's state.
+     *  cancel() beforehand, or detaching it (see setRestart()).\n
+     *  Automatically updates the function's state.\n
+     *  The function is run by the executor, see setExecutor().
      *  @param[in] args The arguments to give to _asyncFunction()
      *  @sa isRunning(), isPending()
      */
-    void run(_Args... args) noexcept
+    void run(_Args... args) noexcept try
     {
-        cancel();
-        _running_state = _RunningState::running;
-        _future = std::async(std::launch::async, &Async::_intermediateFunction, this, args...);
+        if (_coalescing()) {
+            _defer([this, ...args = std::move(args)]() mutable {
+                run(std::move(args)...);
+            });
+            return;
+        }
+        _launch([this, ...args = std::move(args)]() mutable {
+            _asyncFunction(std::forward<_Args>(args)...);
+        });
     }
+    CATCH_ASYNCBASE_ERROR;
 
 private:
 
@@ -145,21 +521,100 @@ private:
      *  prematurely if it returns \c true.
      *  @param[in] args The argument(s) of type \c _Args
      *  defined in your class declaration.
+     *  @note Observers are notified from pollAsync(). Types emitting
+     *  events from this function should call _makeConcurrent()
+     *  from their constructor.
      */
     virtual void _asyncFunction(_Args... args) = 0;
+};
+
+/** SSS::Async variant whose function returns a result.
+ *
+ *  Arguments given to run() are perfectly forwarded into the run, then
+ *  moved into _asyncFunction(): move-only types are accepted, and
+ *  rvalues are never copied. The returned value is moved to
+ *  _onResult(), called from pollAsync() once the run was handled.
+ *  Results of canceled or superseded runs are dropped.
+ *
+ *  @usage
+ *  @code
+ *  class Thumbnailer : public SSS::AsyncResult<RGBA32::Vector, RGBA32::Vector> {
+ *      RGBA32::Vector _asyncFunction(RGBA32::Vector pixels) override;
+ *      void _onResult(RGBA32::Vector&& thumbnail) override;
+ *  };
+ *  thumbnailer.run(std::move(pixels));
+ *  @endcode
+ *  @param[in] R The type returned by _asyncFunction(), which
+ *  needs to be move constructible.
+ *  @param[in] ..._Args All types of arguments taken by _asyncFunction().
+ */
+template <class R, class... _Args>
+class AsyncResult : public _internal::AsyncBase {
+    static_assert(!std::is_void_v<R>, "Use SSS::Async for functions without result.");
+public:
+    /** The type returned by _asyncFunction().*/
+    using Result = R;
 
-    // Calls _asyncFunction and sets _running_state accordingly
-    void _intermediateFunction(_Args... args) noexcept try
+    /** Runs user defined _asyncFunction() with given arguments,
+     *  like Async::run() does.
+     *  @param[in] args The arguments to construct the arguments of
+     *  _asyncFunction() from, forwarded.
+     */
+    template <class... Args>
+        requires std::is_constructible_v<std::tuple<_Args...>, Args&&...>
+    void run(Args&&... args) noexcept try
     {
-        if (Log::Async::query(Log::Async::get().run_state)) {
-            LOG_OBJ_MSG("Function started running.");
+        if (_coalescing()) {
+            _defer([this, args = std::tuple<_Args...>(std::forward<Args>(args)...)]() mutable {
+                std::apply([this](auto&&... a) { run(std::move(a)...); }, std::move(args));
+            });
+            return;
         }
+        auto box = std::make_shared<std::optional<R>>();
+        _result = box;
+        _launch([this, box = std::move(box),
+            args = std::tuple<_Args...>(std::forward<Args>(args)...)]() mutable
+        {
+            box->emplace(std::apply([this](auto&&... a) -> R {
+                return _asyncFunction(std::forward<decltype(a)>(a)...);
+            }, std::move(args)));
+        });
+    }
+    CATCH_ASYNCBASE_ERROR;
 
-        if (_is_canceled) return;
-        _asyncFunction(args...);
-        _postRun();
+private:
+    /** Pure virtual private function called from run():
+     *  implement your own async logic in this function.
+     *  See Async::_asyncFunction().
+     *  @return The result to move to _onResult().
+     */
+    virtual R _asyncFunction(_Args... args) = 0;
+
+    /** Pure virtual private function called from pollAsync()
+     *  once the run was handled and observers were notified.
+     *  The instance may be destroyed from there.
+     *  @param[in] result The result of _asyncFunction().
+     */
+    virtual void _onResult(R&& result) = 0;
+
+    void _claimResult() noexcept override final
+    {
+        _handled_result = std::move(_result);
+    };
+
+    void _handled() noexcept override final try
+    {
+        std::shared_ptr<std::optional<R>> const box = std::move(_handled_result);
+        if (box && box->has_value()) {
+            _onResult(std::move(**box));
+        }
     }
     CATCH_ASYNCBASE_ERROR;
+
+    // Result of the latest run, filled by the executor
+    std::shared_ptr<std::optional<R>> _result;
+    // Result of the run being handled, see _claimResult()
+    std::shared_ptr<std::optional<R>> _handled_result;
 };
 
 SSS_END;
@@ -0,0 +1,315 @@
+#ifndef SSS_COMMONS_COROUTINE_HPP
+#define SSS_COMMONS_COROUTINE_HPP
+
+#include "_includes.hpp"
+#include "Async.hpp"
+
+/** @file
+ *  Defines SSS::Coroutine class, and its SSS::background() and
+ *  SSS::nextPoll() awaiters.
+ */
+
+SSS_BEGIN;
+
+template <class T = void>
+class Coroutine;
+
+INTERNAL_BEGIN;
+
+// Resumes the awaiting coroutine, if any, once a Coroutine ends
+template <class Promise>
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; };
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+        Promise& promise = handle.promise();
+        std::coroutine_handle<> const continuation = promise.continuation;
+        if (promise.detached) {
+            handle.destroy();
+        }
+        return continuation ? continuation : std::noop_coroutine();
+    };
+    void await_resume() const noexcept {};
+};
+
+template <class T>
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+    bool detached{ false };
+
+    std::suspend_never initial_suspend() const noexcept { return {}; };
+    void unhandled_exception() noexcept { error = std::current_exception(); };
+};
+
+template <class T>
+struct CoroutinePromise : PromiseBase<T> {
+    std::optional<T> value;
+
+    Coroutine<T> get_return_object() noexcept;
+    FinalAwaiter<CoroutinePromise> final_suspend() const noexcept { return {}; };
+    template <class V>
+    void return_value(V&& v) { value.emplace(std::forward<V>(v)); };
+};
+
+template <>
+struct CoroutinePromise<void> : PromiseBase<void> {
+    Coroutine<void> get_return_object() noexcept;
+    FinalAwaiter<CoroutinePromise> final_suspend() const noexcept { return {}; };
+    void return_void() const noexcept {};
+};
+
+// Awaiter running a function on the executor of SSS::Async, then
+// resuming the awaiting coroutine from pollAsync() once handled,
+// or with an error if the run is dropped or fails to launch
+template <class F>
+class BackgroundStep final : public Async<> {
+public:
+    using Result = std::invoke_result_t<F&>;
+
+    explicit BackgroundStep(F func) : _func(std::move(func)) {};
+    // Wait for the function, which uses derived members.
+    // The coroutine frame is being destroyed, don't resume it.
+    ~BackgroundStep() { _coroutine = nullptr; cancel(); };
+
+    bool await_ready() const noexcept { return false; };
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        _coroutine = handle;
+        _suspending = true;
+        run();
+        _suspending = false;
+        // Resumed right away if the run was dropped meanwhile
+        return _coroutine != nullptr;
+    };
+    Result await_resume()
+    {
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*_result);
+        }
+    };
+
+private:
+    void _asyncFunction() override
+    {
+        try {
+            if constexpr (std::is_void_v<Result>) {
+                _func();
+            }
+            else {
+                _result.emplace(_func());
+            }
+        }
+        catch (...) {
+            _error = std::current_exception();
+        }
+    };
+
+    void _handled() noexcept override
+    {
+        if (std::coroutine_handle<> const coroutine = std::exchange(_coroutine, nullptr)) {
+            coroutine.resume();
+        }
+    };
+
+    void _dropped(std::exception_ptr error) noexcept override
+    {
+        if (!_coroutine) {
+            return;
+        }
+        _error = error ? error
+            : std::make_exception_ptr(std::runtime_error("SSS::background(): step was canceled."));
+        // Resuming from within await_suspend() would destroy this awaiter
+        if (_suspending) {
+            _coroutine = nullptr;
+        }
+        else {
+            _handled();
+        }
+    };
+
+    F _func;
+    std::coroutine_handle<> _coroutine;
+    bool _suspending{ false };
+    std::optional<std::conditional_t<std::is_void_v<Result>, bool, Result>> _result;
+    std::exception_ptr _error;
+};
+
+// Awaiter resuming the awaiting coroutine from the next pollAsync()
+class NextPoll {
+public:
+    NextPoll() = default;
+    NextPoll(NextPoll const&) = delete;
+    // The coroutine frame is being destroyed while suspended
+    ~NextPoll() { if (_coroutine) cancelResumeOnPoll(_coroutine); };
+
+    bool await_ready() const noexcept { return false; };
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        _coroutine = handle;
+        resumeOnPoll(handle);
+    };
+    void await_resume() noexcept { _coroutine = nullptr; };
+
+private:
+    std::coroutine_handle<> _coroutine;
+};
+
+INTERNAL_END;
+
+/** Coroutine type for sequences mixing background work and main thread steps.
+ *
+ *  A coroutine starts right away on the calling thread, until its first
+ *  \c co_await. Awaiting background() runs a function on the executor of
+ *  SSS::Async, then resumes the coroutine from pollAsync(), on the
+ *  thread polling (usually the main one). No thread is ever blocked
+ *  on a future meanwhile.
+ *
+ *  Coroutines can await other coroutines, and are resumed right
+ *  when those end. Destroying a coroutine which didn't end
+ *  destroys its frame, waiting for its background step, if any.
+ *
+ *  @usage
+ *  @code
+ *  SSS::Coroutine<> loadLevel(Level& level)
+ *  {
+ *      Mesh mesh = co_await SSS::background([&] { return parseMesh(level.path); });
+ *      level.upload(mesh);     // Main thread, during pollAsync()
+ *      level.atlas = co_await SSS::background([&] { return buildAtlas(level); });
+ *  }
+ *  @endcode
+ *  @param[in] T The type returned via \c co_return.
+ */
+template <class T>
+class Coroutine {
+public:
+    /** \cond INTERNAL*/
+    using promise_type = _internal::CoroutinePromise<T>;
+    explicit Coroutine(std::coroutine_handle<promise_type> handle) noexcept
+        : _handle(handle) {};
+    /** \endcond*/
+
+    Coroutine(Coroutine&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {};
+    Coroutine& operator=(Coroutine&& other) noexcept
+    {
+        if (this != &other) {
+            _destroy();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    };
+    Coroutine(Coroutine const&) = delete;
+    Coroutine& operator=(Coroutine const&) = delete;
+    /** Destroys the coroutine frame, unless detach() was called.*/
+    ~Coroutine() { _destroy(); };
+
+    /** Returns \c true if the coroutine ended, successfully or not.*/
+    inline bool isDone() const noexcept { return !_handle || _handle.done(); };
+
+    /** Returns the coroutine's result, which should be done.
+     *  @throws Any exception escaping the coroutine.
+     */
+    decltype(auto) get() const
+    {
+        if (!_handle || !_handle.done()) {
+            throw_exc("Coroutine::get(): coroutine isn't done.");
+        }
+        if (_handle.promise().error) {
+            std::rethrow_exception(_handle.promise().error);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return static_cast<T const&>(*_handle.promise().value);
+        }
+    };
+
+    /** Lets the coroutine run to its end on its own, destroying
+     *  its frame once done. This handle becomes empty.
+     */
+    void detach() noexcept
+    {
+        if (!_handle) {
+            return;
+        }
+        if (_handle.done()) {
+            _handle.destroy();
+        }
+        else {
+            _handle.promise().detached = true;
+        }
+        _handle = nullptr;
+    };
+
+    /** \cond INTERNAL*/
+    bool await_ready() const noexcept { return isDone(); };
+    void await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        _handle.promise().continuation = awaiting;
+    };
+    T await_resume()
+    {
+        if (_handle.promise().error) {
+            std::rethrow_exception(_handle.promise().error);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*_handle.promise().value);
+        }
+    };
+    /** \endcond*/
+
+private:
+    void _destroy() noexcept
+    {
+        if (_handle) {
+            _handle.destroy();
+            _handle = nullptr;
+        }
+    };
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+INTERNAL_BEGIN;
+
+template <class T>
+Coroutine<T> CoroutinePromise<T>::get_return_object() noexcept
+{
+    return Coroutine<T>(std::coroutine_handle<CoroutinePromise>::from_promise(*this));
+}
+
+inline Coroutine<void> CoroutinePromise<void>::get_return_object() noexcept
+{
+    return Coroutine<void>(std::coroutine_handle<CoroutinePromise>::from_promise(*this));
+}
+
+INTERNAL_END;
+
+/** Returns an awaiter running the given function in the background,
+ *  and resuming the awaiting coroutine from pollAsync().
+ *  The awaiter's result is the function's result, and any
+ *  exception it threw is rethrown in the coroutine, as is
+ *  any exception preventing the function from launching.
+ *  @param[in] func The function to run, taking no arguments.
+ *  @sa SSS::Coroutine
+ */
+template <class F>
+auto background(F&& func)
+{
+    return _internal::BackgroundStep<std::decay_t<F>>(std::forward<F>(func));
+}
+
+/** Returns an awaiter resuming the awaiting coroutine from the next
+ *  pollAsync(), e.g. to spread main thread work over several frames.
+ *  No function is run on the executor meanwhile.
+ *  @sa SSS::Coroutine
+ */
+inline auto nextPoll()
+{
+    return _internal::NextPoll{};
+}
+
+SSS_END;
+
+#endif // SSS_COMMONS_COROUTINE_HPP
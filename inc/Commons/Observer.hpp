@@ -16,12 +16,14 @@ struct SSS_COMMONS_API Event {
 };
 
 class SSS_COMMONS_API Observer;
+class SSS_COMMONS_API EventBus;
 
 class SSS_COMMONS_API Subject
 {
     friend class Observer;
+    friend class EventBus;
 public:
-    Subject() = default;
+    Subject();
     Subject(Subject&&) = delete;
     Subject(Subject const&) = delete;
     virtual ~Subject();
@@ -33,12 +35,77 @@ public:
 
 protected:
     void _notifyObservers(int event_id = 0, int charges = -1) const;
+    // Queues the event, notifying observers on the next EventBus::flush()
+    void _queueEvent(int event_id = 0, int charges = -1) const;
+    // Queues the event if EventBus is deferred, notifies observers otherwise
+    void _emitEvent(int event_id = 0, int charges = -1) const;
+
+    // Opt-in, to be called from the constructor before observers attach.
+    // Makes notification safe from any thread, concurrently with attach
+    // and detach: notifiers walk an immutable snapshot of the observers,
+    // only locking the subject's own mutex to grab it, never while calling
+    // observers. Each attach or detach copies the list of observers (O(n),
+    // sharing their filtered IDs), which suits subjects with few observers.
+    // Subjects which aren't concurrent, and their observers, are to be
+    // used from a single thread. Detaching an observer waits for its calls in progress on other
+    // threads, so that it may be destroyed right after. ~Observer() runs
+    // once the derived part is destroyed, so derived observers of such
+    // subjects must detach in their own destructor (see _ignoreAll()).
+    // A given observer should still be attached and detached (including
+    // from its own _subjectUpdate()) from one thread at a time.
+    void _makeConcurrent();
 
 private:
-    std::list<std::reference_wrapper<Observer>> _observers;
-
-    void _attachObserver(Observer& observer);
-    void _detachObserver(Observer const& observer);
+    // Observers in attach order, detached ones being tombstones (nullptr)
+    // until compacted, each knowing the index of its matching link.
+    // Event IDs are filtered through a 64-bit mask (all ones for no
+    // filter), then through the slot's IDs. Event IDs being hashes of
+    // their names, the mask only skips most IDs of other events.
+    // Concurrent subjects guard their slots with their own mutex.
+    struct _LinkState;
+    struct _Slot {
+        Observer* observer;
+        std::size_t link;
+        std::uint64_t mask;
+        // Sorted IDs of the events to receive, null meaning all.
+        // Immutable, so that snapshots share them.
+        std::shared_ptr<std::vector<int> const> event_ids;
+        // Concurrent mode only, shared with snapshots and the link
+        std::shared_ptr<_LinkState> state;
+    };
+    std::vector<_Slot> _slots;
+    std::size_t _dead{ 0 };
+    // Union of the masks of all slots, so that events
+    // no observer is interested in return right away
+    std::uint64_t _mask{ 0 };
+
+    static constexpr std::uint64_t _bit(int event_id) noexcept {
+        return std::uint64_t(1) << (static_cast<std::uint32_t>(event_id) % 64);
+    };
+    // Compaction is deferred while notifying, as indexes must stay valid
+    mutable int _notifying{ 0 };
+    // Number of events queued in EventBus, purged on destruction
+    mutable std::atomic<std::uint32_t> _queued_events{ 0 };
+
+    // Concurrent mode state, see _makeConcurrent()
+    struct _Snapshot;
+    struct _Concurrent;
+    // Shared with links, which may outlive the subject
+    std::shared_ptr<_Concurrent> _concurrent;
+
+    // Locks the subject's mutex itself, if concurrent
+    void _attach(Observer& observer, std::shared_ptr<std::vector<int> const> event_ids,
+        std::uint64_t mask);
+    // Those expect the subject's mutex to be locked, if concurrent
+    void _detachSlot(std::size_t slot) noexcept;
+    void _compact() noexcept;
+    void _publish();
+
+    // Detaches the link of a concurrent subject, even if destroyed
+    static void _detachConcurrent(_LinkState& state) noexcept;
+    // Waits for calls in progress on other threads of a detached link
+    static void _waitCalls(_LinkState& state) noexcept;
+    void _notifyConcurrent(int event_id, int charges) const;
 };
 
 class SSS_COMMONS_API Observer
@@ -52,7 +119,13 @@ public:
 
 protected:
     void _ignore(Subject& subject);
+    // Detaches from all subjects, waiting for calls in progress
+    // on other threads (see Subject::_makeConcurrent())
+    void _ignoreAll() noexcept;
     void _observe(Subject& subject);
+    // Only receives events of the given IDs from the subject,
+    // or all of them if the list is empty (same as above)
+    void _observe(Subject& subject, std::vector<int> event_ids);
 
     template<std::derived_from<Subject> T>
     void _set(std::shared_ptr<T>& dst, std::shared_ptr<T> src) {
@@ -62,13 +135,93 @@ protected:
             _observe(*src.get());
         dst = src;
     }
+    template<std::derived_from<Subject> T>
+    void _set(std::shared_ptr<T>& dst, std::shared_ptr<T> src, std::vector<int> event_ids) {
+        if (dst)
+            _ignore(*dst.get());
+        if (src)
+            _observe(*src.get(), std::move(event_ids));
+        dst = src;
+    }
 
 private:
-    std::list<std::reference_wrapper<Subject>> _subjects;
+    // Observed subjects in no particular order, each knowing
+    // the index of its matching slot, for O(1) detach. Links to
+    // concurrent subjects go through their state instead, so that
+    // subjects never update them, and are dropped once detached.
+    struct _Link {
+        Subject* subject;
+        std::size_t slot;
+        std::shared_ptr<Subject::_LinkState> state;
+    };
+    std::vector<_Link> _links;
+
+    void _removeLink(std::size_t link) noexcept;
+    // Drops links to destroyed concurrent subjects
+    void _dropDeadLinks() noexcept;
 
     virtual void _subjectUpdate(Subject const& subject, Event const& event) = 0;
 };
 
+// Queue of events emitted by subjects, dispatched in order on flush(),
+// typically once per frame. Buffers are reused, so that queueing
+// doesn't allocate once they reached their steady state size.
+class SSS_COMMONS_API EventBus
+{
+    friend class Subject;
+public:
+    static EventBus& get();
+
+    // Notifies observers of all queued events, in queue order.
+    // Events queued meanwhile are dispatched on the next flush.
+    void flush();
+
+    // While deferred, events emitted via _emitEvent() (EMIT_EVENT) are queued
+    void setDeferred(bool deferred) noexcept;
+    bool isDeferred() const noexcept;
+
+    // While coalescing, queueing an event already queued with the same
+    // subject, ID and charges is a no-op (the first one keeps its place)
+    void setCoalescing(bool coalescing) noexcept;
+    bool isCoalescing() const noexcept;
+
+    std::size_t pendingCount() const;
+    // Number of events dropped as duplicates while coalescing
+    std::uint64_t coalescedCount() const noexcept;
+
+private:
+    EventBus() = default;
+    EventBus(EventBus const&) = delete;
+
+    struct _Entry {
+        Subject const* subject;   // nullptr once purged
+        int id;
+        int charges;
+    };
+    // Slot of the coalescing hash table, empty if from an older generation
+    struct _Bucket {
+        std::uint32_t generation;
+        std::uint32_t index;
+    };
+
+    void _push(Subject const& subject, int event_id, int charges);
+    void _purge(Subject const& subject) noexcept;
+    // Returns true if the event is already queued, else indexes it
+    bool _coalesce(_Entry const& entry);
+    void _rehash();
+    static std::size_t _hash(_Entry const& entry) noexcept;
+
+    mutable std::mutex _mutex;
+    std::vector<_Entry> _queue;
+    std::vector<_Entry> _draining;
+    bool _flushing{ false };
+    std::vector<_Bucket> _buckets;
+    std::uint32_t _generation{ 1 };
+    std::atomic<bool> _deferred{ false };
+    std::atomic<bool> _coalescing{ false };
+    std::atomic<std::uint64_t> _coalesced{ 0 };
+};
+
 #pragma warning(pop)
 
 SSS_END;
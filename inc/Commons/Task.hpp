@@ -0,0 +1,366 @@
+#ifndef SSS_COMMONS_TASK_HPP
+#define SSS_COMMONS_TASK_HPP
+
+#include "_includes.hpp"
+#include "ThreadPool.hpp"
+
+/** @file
+ *  Defines SSS::Task class, SSS::spawn() and SSS::when_all() functions.
+ */
+
+SSS_BEGIN;
+
+template <class T = void>
+class Task;
+
+INTERNAL_BEGIN;
+
+// Shared state of a Task, completed exactly once with a value or an exception
+template <class T>
+class TaskState {
+public:
+    using Value = std::conditional_t<std::is_void_v<T>, bool, T>;
+
+    explicit TaskState(ThreadPool& pool) noexcept : pool(pool) {};
+    TaskState(TaskState const&) = delete;
+
+    // Pool continuations are submitted to
+    ThreadPool& pool;
+
+    template <class... V>
+    void setValue(V&&... value)
+    {
+        {
+            std::unique_lock const lock(_mutex);
+            if constexpr (std::is_void_v<T>) {
+                _value.emplace(true);
+            }
+            else {
+                _value.emplace(std::forward<V>(value)...);
+            }
+        }
+        _finish();
+    };
+
+    void setError(std::exception_ptr error)
+    {
+        {
+            std::unique_lock const lock(_mutex);
+            _error = std::move(error);
+        }
+        _finish();
+    };
+
+    inline bool isReady() const noexcept { return _ready.load(std::memory_order_acquire); };
+
+    // Waits for completion. Workers of the pool run other
+    // jobs meanwhile, so that waiting from a job can't deadlock.
+    void wait()
+    {
+        while (!isReady()) {
+            if (pool.isWorker()) {
+                if (pool.runPending()) {
+                    continue;
+                }
+                std::unique_lock lock(_mutex);
+                _cv.wait_for(lock, std::chrono::milliseconds(1), [this] { return isReady(); });
+            }
+            else {
+                std::unique_lock lock(_mutex);
+                _cv.wait(lock, [this] { return isReady(); });
+            }
+        }
+    };
+
+    // Those may only be called once ready
+    inline std::exception_ptr const& error() const noexcept { return _error; };
+    inline Value const& value() const noexcept { return *_value; };
+
+    // Submits the given job to the pool once ready
+    void onReady(Job job)
+    {
+        {
+            std::unique_lock const lock(_mutex);
+            if (!isReady()) {
+                _continuations.emplace_back(std::move(job));
+                return;
+            }
+        }
+        pool.submit(std::move(job));
+    };
+
+private:
+    void _finish()
+    {
+        std::vector<Job> continuations;
+        {
+            std::unique_lock const lock(_mutex);
+            _ready.store(true, std::memory_order_release);
+            continuations.swap(_continuations);
+        }
+        _cv.notify_all();
+        for (Job& job : continuations) {
+            pool.submit(std::move(job));
+        }
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::atomic<bool> _ready{ false };
+    std::optional<Value> _value;
+    std::exception_ptr _error;
+    std::vector<Job> _continuations;
+};
+
+// Calls the given function, then completes the given state with its result
+template <class T, class F, class... Args>
+void fulfill(TaskState<T>& state, F& func, Args const&... args) noexcept try
+{
+    if constexpr (std::is_void_v<T>) {
+        std::invoke(func, args...);
+        state.setValue();
+    }
+    else {
+        state.setValue(std::invoke(func, args...));
+    }
+}
+catch (...) {
+    state.setError(std::current_exception());
+}
+
+template <class F, class T>
+struct ThenResult { using type = std::invoke_result_t<F&, T const&>; };
+template <class F>
+struct ThenResult<F, void> { using type = std::invoke_result_t<F&>; };
+
+INTERNAL_END;
+
+/** Handle to the result of a job run by a SSS::ThreadPool.
+ *
+ *  Unlike \c std::future, a task can be chained with then(): the
+ *  continuation is submitted to the pool as soon as the task
+ *  completes, straight from the worker which completed it.
+ *  Handles are cheap to copy, and all copies share the same result.
+ *
+ *  @usage
+ *  @code
+ *  std::vector<SSS::Task<Image>> decoded;
+ *  for (auto const& path : paths) {
+ *      decoded.push_back(SSS::spawn([path] { return decode(path); }));
+ *  }
+ *  SSS::Task<Atlas> atlas = SSS::when_all(decoded).then(buildAtlas);
+ *  @endcode
+ *  @sa spawn(), when_all()
+ */
+template <class T>
+class Task {
+    template <class>
+    friend class Task;
+    template <class U>
+    friend auto when_all(std::vector<Task<U>> tasks)
+        -> Task<std::conditional_t<std::is_void_v<U>, void, std::vector<U>>>;
+    template <class... Ts>
+    friend Task<void> when_all(Task<Ts> const&... tasks);
+public:
+    /** Type of the result.*/
+    using value_type = T;
+
+    /** Constructs an invalid task, see valid().*/
+    Task() noexcept = default;
+    /** \cond INTERNAL*/
+    explicit Task(std::shared_ptr<_internal::TaskState<T>> state) noexcept
+        : _state(std::move(state)) {};
+    /** \endcond*/
+
+    /** Returns \c true if the task refers to a job.*/
+    inline bool valid() const noexcept { return _state != nullptr; };
+    /** Returns \c true if the job completed, successfully or not.*/
+    inline bool isReady() const noexcept { return _state && _state->isReady(); };
+    /** Waits for the job to complete. When called from a worker of
+     *  the task's pool, other queued jobs are run meanwhile.
+     */
+    void wait() const { _state->wait(); };
+    /** Waits for the job to complete, then returns its result.
+     *  @throws Any exception thrown by the job.
+     */
+    decltype(auto) get() const
+    {
+        _state->wait();
+        if (_state->error()) {
+            std::rethrow_exception(_state->error());
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return _state->value();
+        }
+    };
+
+    /** Returns a task running the given function once this one completes.
+     *  The function receives this task's result by const reference
+     *  (nothing if \c void). If this task threw, the function isn't
+     *  called and the returned task rethrows the same exception.
+     *  @param[in] func The continuation to run on the task's pool.
+     */
+    template <class F>
+    auto then(F&& func) const
+    {
+        using R = typename _internal::ThenResult<std::decay_t<F>, T>::type;
+        auto next = std::make_shared<_internal::TaskState<R>>(_state->pool);
+        _state->onReady([parent = _state, next, func = std::forward<F>(func)]() mutable {
+            if (parent->error()) {
+                next->setError(parent->error());
+            }
+            else if constexpr (std::is_void_v<T>) {
+                _internal::fulfill(*next, func);
+            }
+            else {
+                _internal::fulfill(*next, func, parent->value());
+            }
+        });
+        return Task<R>(std::move(next));
+    };
+
+    /** Returns the pool the task's continuations are submitted to.*/
+    inline ThreadPool& pool() const noexcept { return _state->pool; };
+
+private:
+    std::shared_ptr<_internal::TaskState<T>> _state;
+};
+
+/** Submits the given function to the given pool.
+ *  @param[in] func The function to run, taking no arguments.
+ *  @param[in] pool The pool to run it, and its continuations, on.
+ *  @return A task handle to the function's result.
+ */
+template <class F>
+auto spawn(F&& func, ThreadPool& pool = ThreadPool::shared())
+    -> Task<std::invoke_result_t<std::decay_t<F>&>>
+{
+    using R = std::invoke_result_t<std::decay_t<F>&>;
+    auto state = std::make_shared<_internal::TaskState<R>>(pool);
+    pool.submit([state, func = std::forward<F>(func)]() mutable {
+        _internal::fulfill(*state, func);
+    });
+    return Task<R>(std::move(state));
+}
+
+/** Submits the given function to the given pool, with the given priority.
+ *  @param[in] func The function to run, taking no arguments.
+ *  @param[in] priority The priority class of the function.
+ *  Continuations use Priority::normal.
+ *  @param[in] pool The pool to run it, and its continuations, on.
+ *  @return A task handle to the function's result.
+ *  @sa ThreadPool::submit()
+ */
+template <class F>
+auto spawn(F&& func, Priority priority, ThreadPool& pool = ThreadPool::shared())
+    -> Task<std::invoke_result_t<std::decay_t<F>&>>
+{
+    using R = std::invoke_result_t<std::decay_t<F>&>;
+    auto state = std::make_shared<_internal::TaskState<R>>(pool);
+    pool.submit([state, func = std::forward<F>(func)]() mutable {
+        _internal::fulfill(*state, func);
+    }, priority);
+    return Task<R>(std::move(state));
+}
+
+/** Returns a task completing once all given tasks completed.
+ *  Its result is the vector of their results (nothing if \c void),
+ *  in the same order. If any task threw, the first one's exception
+ *  (in the given order) is rethrown instead.
+ *  @param[in] tasks The tasks to wait for.
+ */
+template <class T>
+auto when_all(std::vector<Task<T>> tasks)
+    -> Task<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>>
+{
+    using R = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+    auto state = std::make_shared<_internal::TaskState<R>>(
+        tasks.empty() ? ThreadPool::shared() : tasks.front().pool());
+
+    struct Join {
+        std::atomic<std::size_t> left;
+        std::vector<Task<T>> tasks;
+    };
+    auto join = std::make_shared<Join>();
+    join->left.store(tasks.size(), std::memory_order_relaxed);
+    join->tasks = std::move(tasks);
+
+    auto const complete = [](Join const& join, _internal::TaskState<R>& state) {
+        for (Task<T> const& task : join.tasks) {
+            if (task._state->error()) {
+                state.setError(task._state->error());
+                return;
+            }
+        }
+        if constexpr (std::is_void_v<T>) {
+            state.setValue();
+        }
+        else {
+            std::vector<T> values;
+            values.reserve(join.tasks.size());
+            for (Task<T> const& task : join.tasks) {
+                values.push_back(task._state->value());
+            }
+            state.setValue(std::move(values));
+        }
+    };
+
+    if (join->tasks.empty()) {
+        complete(*join, *state);
+    }
+    for (Task<T> const& task : join->tasks) {
+        task._state->onReady([join, state, complete]() {
+            if (join->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                complete(*join, *state);
+            }
+        });
+    }
+    return Task<R>(std::move(state));
+}
+
+/** Returns a task completing once all given tasks completed,
+ *  whose results are then available through the given tasks.
+ *  If any task threw, one of their exceptions is rethrown instead.
+ *  @param[in] tasks The tasks to wait for, of any type.
+ */
+template <class... Ts>
+Task<void> when_all(Task<Ts> const&... tasks)
+{
+    static_assert(sizeof...(Ts) != 0, "when_all() needs at least one task.");
+    ThreadPool* pool = nullptr;
+    ((pool = &tasks.pool()), ...);
+    auto state = std::make_shared<_internal::TaskState<void>>(*pool);
+
+    struct Join {
+        std::atomic<std::size_t> left;
+        std::mutex mutex;
+        std::exception_ptr error;
+    };
+    auto join = std::make_shared<Join>();
+    join->left.store(sizeof...(Ts), std::memory_order_relaxed);
+
+    auto const hook = [&](auto const& task) {
+        task._state->onReady([join, state, task_state = task._state]() {
+            if (task_state->error()) {
+                std::unique_lock const lock(join->mutex);
+                if (!join->error) {
+                    join->error = task_state->error();
+                }
+            }
+            if (join->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                if (join->error) {
+                    state->setError(join->error);
+                }
+                else {
+                    state->setValue();
+                }
+            }
+        });
+    };
+    (hook(tasks), ...);
+    return Task<void>(std::move(state));
+}
+
+SSS_END;
+
+#endif // SSS_COMMONS_TASK_HPP
@@ -0,0 +1,268 @@
+#ifndef SSS_COMMONS_THREADPOOL_HPP
+#define SSS_COMMONS_THREADPOOL_HPP
+
+#include "_includes.hpp"
+#include "lockfree.hpp"
+
+/** @file
+ *  Defines SSS::Job and SSS::ThreadPool classes, and SSS::Priority enum.
+ */
+
+SSS_BEGIN;
+
+/** Move-only, type-erased <tt>void()</tt> callable.
+ *  Unlike \c std::function, accepts move-only callables
+ *  such as \c std::packaged_task or lambdas owning a \c std::unique_ptr.
+ */
+class Job {
+public:
+    /** Constructs an empty job.*/
+    Job() noexcept = default;
+    /** Constructs a job owning the given callable.*/
+    template <class F>
+        requires (!std::is_same_v<std::decay_t<F>, Job>) && std::is_invocable_v<std::decay_t<F>&>
+    Job(F&& func)
+        : _impl(std::make_unique<_Model<std::decay_t<F>>>(std::forward<F>(func)))
+    {};
+    Job(Job&&) noexcept = default;
+    Job& operator=(Job&&) noexcept = default;
+    Job(Job const&) = delete;
+    Job& operator=(Job const&) = delete;
+
+    /** Returns \c true if the job holds a callable.*/
+    explicit operator bool() const noexcept { return _impl != nullptr; };
+    /** Calls the held callable, which must exist.*/
+    void operator()() { _impl->call(); };
+
+private:
+    struct _Concept {
+        virtual ~_Concept() = default;
+        virtual void call() = 0;
+    };
+    template <class F>
+    struct _Model final : _Concept {
+        template <class G>
+        explicit _Model(G&& g) : func(std::forward<G>(g)) {};
+        void call() override { func(); };
+        F func;
+    };
+    std::unique_ptr<_Concept> _impl;
+};
+
+/** Priority classes of jobs submitted to a SSS::ThreadPool, most urgent first.
+ *  @sa ThreadPool::submit()
+ */
+enum class Priority {
+    /** Work something is blocked on, e.g. the player is waiting.*/
+    critical,
+    /** Work needed soon, e.g. assets about to be visible.*/
+    high,
+    /** Default priority.*/
+    normal,
+    /** Work which can wait, e.g. streaming far-away assets.
+     *  Held while the pool is throttled.
+     */
+    low,
+    /** Work with no latency expectation at all.
+     *  Held while the pool is throttled.
+     */
+    background
+};
+
+/** Number of SSS::Priority classes.*/
+inline constexpr std::size_t priority_count = 5;
+
+// Ignore warning about STL exports as they're private members
+#pragma warning(push, 2)
+#pragma warning(disable: 4251)
+#pragma warning(disable: 4275)
+
+/** Fixed set of worker threads running submitted jobs, with work stealing.
+ *
+ *  Reusing threads avoids the creation and teardown of an OS thread
+ *  for each job, which \c std::async(std::launch::async) usually pays.
+ *  A shared() instance is used by default by SSS::Async and SSS::Task.
+ *
+ *  Each worker owns a deque: jobs submitted from a worker are pushed
+ *  on its own deque and run in LIFO order (keeping continuations hot
+ *  in cache), while idle workers steal the oldest jobs of others.
+ *  Jobs submitted from other threads, or with a priority other than
+ *  Priority::normal, go through shared queues, one per priority class.
+ *
+ *  Workers run the most urgent job first: critical and high
+ *  priority jobs are run even before a worker's own deque.
+ *  Within a class, jobs with a deadline run earliest deadline first,
+ *  then other jobs in FIFO order. Waiting jobs are promoted one class
+ *  every setAging() step, and jobs whose deadline is closer than one
+ *  step are promoted to Priority::critical, so that none starves.
+ *
+ *  @usage
+ *  @code
+ *  SSS::ThreadPool pool(4);
+ *  std::future<int> result = pool.async([] { return 42; });
+ *  pool.submit(streamChunk, SSS::Priority::low);
+ *  // Hold low priority work while frames are over budget
+ *  pool.setThrottled(frame_timer.isOverBudget());
+ *  @endcode
+ */
+class SSS_COMMONS_API ThreadPool {
+public:
+    /** Starts the given number of worker threads.
+     *  @param[in] threads The number of workers, zero
+     *  meaning \c std::thread::hardware_concurrency().
+     */
+    explicit ThreadPool(std::size_t threads = 0);
+    /** Runs all queued jobs, then joins workers.*/
+    ~ThreadPool();
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    /** Clock used for deadlines.*/
+    using Clock = std::chrono::steady_clock;
+
+    /** Queues the given job, to be run by the first free worker.
+     *  Exceptions escaping the job are caught and logged.
+     */
+    void submit(Job job);
+    /** Queues the given job with the given priority and deadline.
+     *  @param[in] job The job to run.
+     *  @param[in] priority The priority class of the job.
+     *  @param[in] deadline The time the job should have started by,
+     *  \c Clock::time_point::max() meaning none.
+     *  @sa setAging()
+     */
+    void submit(Job job, Priority priority,
+        Clock::time_point deadline = Clock::time_point::max());
+
+    /** Queues the given callable, and returns a future to its result.*/
+    template <class F>
+    std::future<std::invoke_result_t<std::decay_t<F>&>> async(F&& func)
+    {
+        std::packaged_task<std::invoke_result_t<std::decay_t<F>&>()> task(std::forward<F>(func));
+        auto future = task.get_future();
+        submit(std::move(task));
+        return future;
+    };
+
+    /** Returns the number of worker threads.*/
+    inline std::size_t size() const noexcept { return _threads.size(); };
+    /** Returns the number of queued jobs not yet started.*/
+    inline std::size_t pendingCount() const noexcept {
+        return _queued.load(std::memory_order_relaxed);
+    };
+    /** Returns the number of queued jobs of the given priority not yet started.*/
+    inline std::size_t pendingCount(Priority priority) const noexcept {
+        return _stats[static_cast<std::size_t>(priority)].pending.load(std::memory_order_relaxed);
+    };
+
+    /** Queue metrics of a priority class, since the last resetStats().*/
+    struct Stats {
+        /** Jobs queued, not yet started.*/
+        std::size_t pending{ 0 };
+        /** Highest number of jobs queued at once.*/
+        std::size_t peak{ 0 };
+        /** Jobs submitted.*/
+        std::uint64_t submitted{ 0 };
+        /** Jobs started earlier than their own class
+         *  allowed, through aging or their deadline.
+         */
+        std::uint64_t promoted{ 0 };
+        /** Jobs started after their deadline.*/
+        std::uint64_t late{ 0 };
+    };
+    /** Returns the queue metrics of the given priority class.*/
+    Stats stats(Priority priority) const noexcept;
+    /** Resets all queue metrics, except pending counts.*/
+    void resetStats() noexcept;
+
+    /** Sets the time after which a waiting job is promoted one
+     *  priority class, which is also how close to its deadline a
+     *  job gets promoted to Priority::critical. Defaults to 50ms.
+     */
+    void setAging(std::chrono::milliseconds step) noexcept;
+    /** Returns the aging step, see setAging().*/
+    std::chrono::milliseconds getAging() const noexcept;
+
+    /** Holds Priority::low and Priority::background jobs while \c true,
+     *  e.g. while the frame budget is exceeded (see FrameTimer::isOverBudget()).
+     *  Held jobs still run once promoted to Priority::normal by aging.
+     */
+    void setThrottled(bool throttled) noexcept;
+    /** Returns \c true if the pool is throttled, see setThrottled().*/
+    inline bool isThrottled() const noexcept {
+        return _throttled.load(std::memory_order_relaxed);
+    };
+    /** Returns \c true if the calling thread is a worker of this pool.*/
+    bool isWorker() const noexcept;
+    /** Runs one queued job on the calling thread, if any.
+     *  Lets threads waiting on a job help instead of blocking.
+     *  @return \c true if a job was run.
+     */
+    bool runPending();
+
+    /** Returns the pool shared by the library, sized to
+     *  \c std::thread::hardware_concurrency() and created on first call.
+     */
+    static ThreadPool& shared();
+
+private:
+    struct alignas(cache_line_size) _Deque {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+    // Job of the shared queues
+    struct _Entry {
+        Job job;
+        Clock::time_point submitted;
+        Clock::time_point deadline;
+        std::uint64_t seq;
+    };
+    // Shared queues, one heap per priority class
+    struct alignas(cache_line_size) _Queues {
+        std::mutex mutex;
+        std::vector<_Entry> heaps[priority_count];
+        std::uint64_t seq{ 0 };
+    };
+    struct alignas(cache_line_size) _Counters {
+        std::atomic<std::size_t> pending{ 0 };
+        std::atomic<std::size_t> peak{ 0 };
+        std::atomic<std::uint64_t> submitted{ 0 };
+        std::atomic<std::uint64_t> promoted{ 0 };
+        std::atomic<std::uint64_t> late{ 0 };
+    };
+
+    void _loop(std::size_t index) noexcept;
+    // Takes a job from the shared queues if one is urgent, the given
+    // worker's deque, the shared queues, then other workers' deques
+    bool _take(std::size_t index, Job& job);
+    // Takes the most urgent job from the shared queues, if its
+    // class once promoted is at most the given one
+    bool _takeShared(Job& job, std::size_t max_class);
+    // Heap comparator of the shared queues: earliest deadline, then FIFO
+    static bool _later(_Entry const& a, _Entry const& b) noexcept;
+    void _queuedOne(std::size_t index) noexcept;
+    void _startedOne(std::size_t index) noexcept;
+    static void _run(Job& job) noexcept;
+
+    std::vector<std::thread> _threads;
+    std::unique_ptr<_Deque[]> _deques;
+    _Queues _shared;
+    _Counters _stats[priority_count];
+
+    alignas(cache_line_size) std::atomic<std::size_t> _queued{ 0 };
+    std::atomic<std::size_t> _shared_queued{ 0 };
+    // Incremented by each submit(), for workers sleeping while throttled
+    std::atomic<std::uint64_t> _submits{ 0 };
+    std::atomic<long long> _aging_ms{ 50 };
+    std::atomic<bool> _throttled{ false };
+    std::atomic<std::size_t> _sleepers{ 0 };
+    std::mutex _sleep_mutex;
+    std::condition_variable _cv;
+    bool _stopping{ false };
+};
+
+#pragma warning(pop)
+
+SSS_END;
+
+#endif // SSS_COMMONS_THREADPOOL_HPP
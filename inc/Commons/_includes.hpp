@@ -7,7 +7,9 @@
 
 // STL
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
 #include <set>
 #include <stdexcept>
 #include <iostream>
@@ -17,10 +19,26 @@
 #include <future>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <bit>
 #include <string>
 #include <filesystem>
+#include <charconv>
+#include <algorithm>
+#include <limits>
+#include <typeinfo>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <coroutine>
+#include <functional>
+#include <concepts>
+#include <iterator>
 
 // CLib
+#include <cmath>
 #include <cstdlib>
 #include <cstdint>
 #include <cstdio>
@@ -0,0 +1,219 @@
+#ifndef SSS_COMMONS_BINLOG_HPP
+#define SSS_COMMONS_BINLOG_HPP
+
+#include "_includes.hpp"
+#include "log.hpp"
+
+/** @file
+ *  Defines the binary log format, its writer and its decoder.
+ */
+
+SSS_BEGIN;
+
+/** Binary structured logging.
+ *
+ *  Once open() was called, every log message is appended to a
+ *  memory-mapped file as a binary record holding a format ID, a raw
+ *  monotonic timestamp, a thread ID and the raw bytes of its arguments.
+ *  Nothing is formatted when logging: decode() turns the file back into
+ *  the usual <tt>hh:mm:ss.ms| [WRN]: ...</tt> text.
+ *
+ *  SSS::log_msg(), SSS::log_wrn() and SSS::log_err() are redirected as
+ *  well, so that all \c LOG_* macros keep working. The \c LOG_BIN_*
+ *  macros are the fast path: their format string is registered once per
+ *  call site and their arguments are never converted to text.
+ *
+ *  @usage
+ *  @code
+ *  SSS::Log::Binary::open("game.sbl");
+ *  LOG_BIN_WRN("Frame {} took {}ms", frame_id, ms);
+ *  SSS::Log::Binary::close();
+ *  SSS::Log::Binary::decode("game.sbl", std::cout);
+ *  @endcode
+ */
+namespace Log::Binary {
+    /** Opens (and truncates) the given file, and starts writing
+     *  log messages to it instead of \c std::cout and \c std::cerr.
+     *  @param[in] path The path of the file to write to.
+     *  @param[in] chunk_size The size the mapping initially has, and
+     *  grows by when full.
+     *  @throws std::runtime_error If the file couldn't be opened or mapped.
+     *  @sa close()
+     */
+    SSS_COMMONS_API void open(std::string const& path, std::size_t chunk_size = 1 << 24);
+    /** Stops writing binary records, and truncates the file to its used size.*/
+    SSS_COMMONS_API void close() noexcept;
+    /** Returns \c true if binary records are currently being written.*/
+    SSS_COMMONS_API bool isOpen() noexcept;
+
+    /** Converts a binary log file back to text lines.
+     *  @param[in] path The path of the file written after open().
+     *  @param[out] out The stream to write text lines to.
+     *  @param[in] thread_ids Whether to print the ID of the logging
+     *  thread after the time stamp.
+     *  @throws std::runtime_error If the file couldn't be read or
+     *  isn't a binary log file.
+     */
+    SSS_COMMONS_API void decode(std::string const& path, std::ostream& out, bool thread_ids = false);
+
+    INTERNAL_BEGIN;
+
+    // Type tags preceding each argument in a record
+    // (zero is reserved for record padding)
+    enum class Tag : std::uint8_t {
+        i64 = 1, u64, f64, boolean, ptr, str
+    };
+
+    // Returns a small, stable ID for the calling thread
+    SSS_COMMONS_API std::uint32_t threadID() noexcept;
+    // Registers the given format string, and returns its ID
+    SSS_COMMONS_API std::uint32_t registerFormat(Level level, std::string_view format);
+    // Reserves a record of given payload size, returns nullptr if closed.
+    // Needs to be paired with endRecord() if successful.
+    SSS_COMMONS_API char* beginRecord(std::uint32_t format_id, std::size_t payload_size) noexcept;
+    SSS_COMMONS_API void endRecord() noexcept;
+    // Writes a message coming from SSS::log_msg & co, returns false if closed
+    SSS_COMMONS_API bool writeText(Level level, std::string_view str) noexcept;
+
+    template <typename T>
+    inline constexpr bool is_string_v =
+        std::is_convertible_v<T const&, std::string_view>;
+
+    template <typename T>
+    inline std::string_view toView(T const& arg) noexcept
+    {
+        if constexpr (std::is_pointer_v<T>) {
+            return arg != nullptr ? std::string_view(arg) : std::string_view();
+        }
+        else {
+            return std::string_view(arg);
+        }
+    };
+
+    template <typename T>
+    inline std::size_t argSize(T const& arg) noexcept
+    {
+        if constexpr (is_string_v<T>) {
+            return 1 + sizeof(std::uint32_t) + toView(arg).size();
+        }
+        else if constexpr (std::is_same_v<T, char>) {
+            return 1 + sizeof(std::uint32_t) + 1;
+        }
+        else if constexpr (std::is_same_v<T, bool>) {
+            return 2;
+        }
+        else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>) {
+            return 1 + 8;
+        }
+        else {
+            return 1 + sizeof(std::uint32_t) + toString(arg).size();
+        }
+    };
+
+    template <typename V>
+    inline char* writeRaw(char* dst, Tag tag, V const& value) noexcept
+    {
+        *dst++ = static_cast<char>(tag);
+        std::memcpy(dst, &value, sizeof(V));
+        return dst + sizeof(V);
+    };
+
+    inline char* writeStr(char* dst, std::string_view str) noexcept
+    {
+        dst = writeRaw(dst, Tag::str, static_cast<std::uint32_t>(str.size()));
+        std::memcpy(dst, str.data(), str.size());
+        return dst + str.size();
+    };
+
+    template <typename T>
+    inline char* writeArg(char* dst, T const& arg) noexcept
+    {
+        if constexpr (is_string_v<T>) {
+            return writeStr(dst, toView(arg));
+        }
+        else if constexpr (std::is_same_v<T, char>) {
+            return writeStr(dst, std::string_view(&arg, 1));
+        }
+        else if constexpr (std::is_same_v<T, bool>) {
+            return writeRaw(dst, Tag::boolean, static_cast<std::uint8_t>(arg));
+        }
+        else if constexpr (std::is_enum_v<T>) {
+            return writeArg(dst, static_cast<std::underlying_type_t<T>>(arg));
+        }
+        else if constexpr (std::is_floating_point_v<T>) {
+            return writeRaw(dst, Tag::f64, static_cast<double>(arg));
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            return writeRaw(dst, Tag::i64, static_cast<std::int64_t>(arg));
+        }
+        else if constexpr (std::is_integral_v<T>) {
+            return writeRaw(dst, Tag::u64, static_cast<std::uint64_t>(arg));
+        }
+        else if constexpr (std::is_pointer_v<T>) {
+            return writeRaw(dst, Tag::ptr, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(arg)));
+        }
+        else {
+            return writeStr(dst, toString(arg));
+        }
+    };
+
+    // Replaces each "{}" of the format with the next argument
+    template <typename... Args>
+    inline std::string formatText(std::string_view format, Args const&... args)
+    {
+        std::string ret;
+        auto const append = [&](auto const& arg) {
+            std::size_t const pos = format.find("{}");
+            ret += format.substr(0, pos);
+            ret += toString(arg);
+            format.remove_prefix(pos == format.npos ? format.size() : pos + 2);
+        };
+        (append(args), ...);
+        ret += format;
+        return ret;
+    };
+
+    // Writes a binary record, or falls back on the text log functions
+    template <typename... Args>
+    inline void write(Level level, std::uint32_t format_id, std::string_view format,
+        Args const&... args) noexcept try
+    {
+        std::size_t const size = (std::size_t(0) + ... + argSize(args));
+        if (char* dst = beginRecord(format_id, size); dst != nullptr) {
+            ((dst = writeArg(dst, args)), ...);
+            endRecord();
+            return;
+        }
+        switch (level) {
+        case Level::msg: log_msg(formatText(format, args...)); break;
+        case Level::wrn: log_wrn(formatText(format, args...)); break;
+        case Level::err: log_err(formatText(format, args...)); break;
+        }
+    }
+    catch (...) {
+    };
+
+    INTERNAL_END;
+}
+
+SSS_END;
+
+/** Logs a binary record with given format and arguments, each
+ *  <tt>{}</tt> of the format being replaced by the next argument
+ *  when decoded. Falls back on text logging if no file is open.
+ *  @sa SSS::Log::Binary
+ */
+#define LOG_BIN(Level, Fmt, ...) do { \
+    static std::uint32_t const _sss_format_id = \
+        SSS::Log::Binary::_internal::registerFormat(Level, Fmt); \
+    SSS::Log::Binary::_internal::write(Level, _sss_format_id, Fmt __VA_OPT__(,) __VA_ARGS__); \
+} while (0)
+
+#define LOG_BIN_MSG(Fmt, ...) SSS_LOG_AT_(SSS_LOG_LEVEL_MSG) \
+    LOG_BIN(SSS::Log::Level::msg, Fmt __VA_OPT__(,) __VA_ARGS__);
+#define LOG_BIN_WRN(Fmt, ...) SSS_LOG_AT_(SSS_LOG_LEVEL_WRN) \
+    LOG_BIN(SSS::Log::Level::wrn, Fmt __VA_OPT__(,) __VA_ARGS__);
+#define LOG_BIN_ERR(Fmt, ...) SSS_LOG_AT_(SSS_LOG_LEVEL_ERR) \
+    LOG_BIN(SSS::Log::Level::err, Fmt __VA_OPT__(,) __VA_ARGS__);
+
+#endif // SSS_COMMONS_BINLOG_HPP
@@ -140,6 +140,13 @@ SSS_COMMONS_API RGBA32& operator*=(RGBA32& dst, RGBA32 const& src) noexcept;
  *  t=0 returns a, t=1 returns b. t is clamped to [0, 1].*/
 SSS_COMMONS_API RGBA_f mix(const RGBA_f& a, const RGBA_f& b, float t) noexcept;
 
+/** Appends RGB24::to_string() to given string, without intermediate allocation.*/
+SSS_COMMONS_API void toString(std::string& out, RGB24 const& color);
+/** Appends RGBA32::to_string() to given string, without intermediate allocation.*/
+SSS_COMMONS_API void toString(std::string& out, RGBA32 const& color);
+/** Appends RGBA_f::to_string() to given string, without intermediate allocation.*/
+SSS_COMMONS_API void toString(std::string& out, RGBA_f const& color);
+
 
 
 SSS_END;
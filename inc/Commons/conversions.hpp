@@ -9,10 +9,111 @@
 
 SSS_BEGIN;
 
+INTERNAL_BEGIN;
+
+template <typename T>
+concept Streamable = requires(std::ostream& stream, T const& arg) { stream << arg; };
+
+template <typename T>
+concept HasToString = requires(T const& arg) {
+    { arg.to_string() } -> std::convertible_to<std::string>;
+};
+
+template <typename T>
+inline constexpr bool is_char_v = std::is_same_v<T, char>
+    || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>;
+
+// Appends the integral value, formatted in given base
+template <typename T>
+inline void appendInteger(std::string& out, T value, int base = 10)
+{
+    char buff[std::numeric_limits<T>::digits + 2];
+    auto const [end, ec] = std::to_chars(buff, buff + sizeof(buff), value, base);
+    out.append(buff, end);
+}
+
+// Appends the floating point value, formatted as std::ostream does by default
+template <typename T>
+inline void appendFloat(std::string& out, T value)
+{
+    char buff[64];
+    auto const [end, ec] = std::to_chars(buff, buff + sizeof(buff), value,
+        std::chars_format::general, 6);
+    out.append(buff, end);
+}
+
+// Appends the address, formatted as std::ostream does on MSVC
+inline void appendPointer(std::string& out, void const* ptr)
+{
+    constexpr std::size_t width = sizeof(void*) * 2;
+    char buff[width];
+    std::fill(buff, buff + width, '0');
+    auto const value = reinterpret_cast<std::uintptr_t>(ptr);
+    char tmp[width];
+    auto const [end, ec] = std::to_chars(tmp, tmp + width, value, 16);
+    std::size_t const size = end - tmp;
+    std::transform(tmp, end, buff + width - size, [](char c) {
+        return static_cast<char>(c >= 'a' ? c - 'a' + 'A' : c);
+    });
+    out.append(buff, width);
+}
+
+INTERNAL_END;
+
+/** Appends given data of type \c T, converted to string, to given string.
+ *  Booleans, characters, strings, arithmetic types, pointers and types
+ *  with a \c to_string() method (eg: color types) are formatted directly,
+ *  without any allocation other than the growth of \c out.\n
+ *  Other types are fed to an \c std::ostringstream, and thus need to
+ *  have an <b>insertion operator</b> available.
+ *  @param[in,out] out The string to append the converted data to.
+ *  @param[in] arg The data of type \c T to be converted.
+ */
+template <typename T>
+inline void toString(std::string& out, T const& arg) noexcept try
+{
+    if constexpr (std::is_same_v<T, bool>) {
+        out += arg ? "true" : "false";
+    }
+    else if constexpr (_internal::is_char_v<T>) {
+        out += static_cast<char>(arg);
+    }
+    else if constexpr (std::is_convertible_v<T const&, std::string_view>) {
+        if constexpr (std::is_pointer_v<T>) {
+            if (arg == nullptr) {
+                return;
+            }
+        }
+        out += std::string_view(arg);
+    }
+    else if constexpr (std::is_integral_v<T>) {
+        _internal::appendInteger(out, arg);
+    }
+    else if constexpr (std::is_floating_point_v<T>) {
+        _internal::appendFloat(out, arg);
+    }
+    else if constexpr (std::is_pointer_v<T> && !std::is_function_v<std::remove_pointer_t<T>>) {
+        _internal::appendPointer(out, arg);
+    }
+    else if constexpr (std::is_enum_v<T> && !_internal::Streamable<T>) {
+        _internal::appendInteger(out, static_cast<std::underlying_type_t<T>>(arg));
+    }
+    else if constexpr (_internal::HasToString<T> && !_internal::Streamable<T>) {
+        out += arg.to_string();
+    }
+    else {
+        std::ostringstream strstream;
+        strstream << std::boolalpha << arg;
+        out += std::move(strstream).str();
+    }
+}
+catch (...) {
+    out += "[SSS::toString() error]";
+};
+
 /** Converts given data of type \c T to string if possible.
- *  Given data of type \c T will be fed to an \c std::ostringstream.\n
- *  Hence, type \c T needs to have an <b>insertion operator</b> available.\n
- *  This function isn't the fastest, but aspires to be the most practical.
+ *  Uses toString(std::string&, T const&), see its documentation
+ *  for which types are formatted without \c std::ostringstream.
  *  @param[in] arg The data of type \c T to be converted.
  *  @return A string containing either the converted data or an error
  *  message if an exception was caught <em>(which should not happen)</em>.
@@ -20,9 +121,9 @@ SSS_BEGIN;
 template <typename T>
 inline std::string toString(T const& arg) noexcept try
 {
-    std::ostringstream strstream;
-    strstream << std::boolalpha << arg;
-    return strstream.str();
+    std::string ret;
+    toString(ret, arg);
+    return ret;
 }
 catch (...) {
     return "[SSS::toString() error]";
@@ -31,6 +132,37 @@ catch (...) {
 template<>
 inline std::string toString(std::string const& arg) noexcept { return arg; };
 
+/** Concatenates given context and message, separated by <tt>": "</tt>,
+ *  in a single allocation-friendly string.
+ *  @sa #CONTEXT_MSG
+ */
+template <typename Context, typename Message>
+inline std::string contextMsg(Context const& cxt, Message const& msg)
+{
+    std::string ret;
+    toString(ret, cxt);
+    ret += ": ";
+    toString(ret, msg);
+    return ret;
+};
+
+/** Returns the readable name of the given type.
+ *  Names are demangled via \c abi::__cxa_demangle on GCC & Clang, and
+ *  stripped of their <tt>"class "</tt>, <tt>"struct "</tt> (etc) keywords
+ *  on MSVC. Each name is computed once and interned, so that subsequent
+ *  calls only cost a hash lookup.
+ *  @param[in] info The \c typeid of the type.
+ *  @return A view over the interned name, valid until the program ends.
+ */
+SSS_COMMONS_API std::string_view typeName(std::type_info const& info);
+/** Returns the readable name of type \c T, see typeName(std::type_info const&).*/
+template <typename T>
+inline std::string_view typeName()
+{
+    static std::string_view const name = typeName(typeid(T));
+    return name;
+};
+
 /** Converts \c std::string to \c std::u32string.
  *  @param[in] str The \c std::string to convert.
  *  @return The converted \c std::u32string.
@@ -14,11 +14,24 @@
 
 // Register the event to the global Event List
 #define REGISTER_EVENT(Str) SSS::EventManager::registerEvent(Str)
+// IDs of string literals are hashed at compile time, whether the event is
+// registered or not: an unregistered (e.g. misspelled) name is emitted to
+// no observer. Debug builds check the name and log an error instead.
+#ifdef _DEBUG
+#define SSS_EMITTED_ID_(Str) SSS::EventManager::checkEmitted(SSS::EventManager::eventID(Str), Str)
+#else
+#define SSS_EMITTED_ID_(Str) SSS::EventManager::eventID(Str)
+#endif
 // Emit and notify the event to all the concerned observers
 // Optional second argument limits propagation to N observers (charges)
-#define EMIT_EVENT(Str, ...)  _notifyObservers(SSS::EventManager::eventID(Str) __VA_OPT__(,) __VA_ARGS__)
-// Get the ID of the Event from its name
+// Queued instead when SSS::EventBus is deferred
+#define EMIT_EVENT(Str, ...)  _emitEvent(SSS_EMITTED_ID_(Str) __VA_OPT__(,) __VA_ARGS__)
+// Queue the event, notified on the next SSS::EventBus::flush()
+#define QUEUE_EVENT(Str, ...) _queueEvent(SSS_EMITTED_ID_(Str) __VA_OPT__(,) __VA_ARGS__)
+// Get the ID of the Event from its name, at compile time for string literals
 #define EVENT_ID(Str)       SSS::EventManager::eventID(Str)
+// Observe the subject, only receiving the given events
+#define OBSERVE_EVENTS(Subject, ...) _observe(Subject, SSS::EventManager::eventIDs({ __VA_ARGS__ }))
 
 /*          Event Utils             */ 
 // Get the complete registered event list
@@ -29,6 +42,30 @@
 
 SSS_BEGIN;
 
+/** Returns the ID of the given event name: its 32-bit FNV-1a hash,
+ *  folded in [0, INT32_MAX) as \c INT32_MAX stands for unknown events.
+ *  Colliding names are rejected by EventManager::registerEvent().
+ */
+constexpr int eventHash(std::string_view name) noexcept
+{
+    std::uint32_t hash = 2166136261u;
+    for (char const c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return static_cast<int>(hash % static_cast<std::uint32_t>(INT32_MAX));
+}
+
+inline namespace literals {
+    /** Returns the ID of the event at compile time, e.g. \c "Resize"_event.
+     *  @sa eventHash()
+     */
+    consteval int operator""_event(char const* name, std::size_t size)
+    {
+        return eventHash(std::string_view(name, size));
+    }
+}
+
 template <typename Derived>
 class _EventRegistry {
 protected:
@@ -38,7 +75,7 @@ private:
     static std::once_flag init_flag;
 
     static void init() {
-        log_msg("Event registration for class <" + SSS::toString(typeid(Derived).name()) + ">");
+        log_msg("Event registration for class <" + std::string(typeName<Derived>()) + ">");
         Derived::_register();
     }
 };
@@ -67,8 +104,29 @@ public:
      *  their value.
      */
     static std::vector<std::string>  eventList();
+    /** Registers the event to the global Event List.
+     *  @throw std::runtime_error If its ID collides with the one
+     *  of another registered event.
+     */
     static void registerEvent(const std::string &eventName);
+    /** Returns the ID of the registered event, or \c INT32_MAX
+     *  (logging an error) if it isn't registered.
+     */
     static int eventID(const std::string &eventName);
+    /** Returns the ID of the event at compile time, without checking
+     *  that it is registered. Used for string literals, e.g. via
+     *  EMIT_EVENT, so that emitting costs no lookup.
+     */
+    template <std::size_t N>
+    static consteval int eventID(const char (&eventName)[N])
+    {
+        return eventHash(std::string_view(eventName, N - 1));
+    };
+    /** Logs an error if the given event isn't registered, see
+     *  EMIT_EVENT. Returns \c id, for debug builds to wrap IDs with.
+     */
+    static int checkEmitted(int id, std::string_view eventName);
+    static std::vector<int> eventIDs(std::initializer_list<std::string> eventNames);
     static std::string findName(const int &id);
     /** Sets the loudened mode state to \c true or \c false.
      *  In loudened mode, all subsequent log flags act as if
@@ -76,7 +134,8 @@ public:
      *  their value.
      */
 protected :
-    std::unordered_map < std::string, int > _eventlist;
+    // Event names by ID, the ID being the hash of the name
+    std::unordered_map < int, std::string > _eventlist;
 };
 
 SSS_END;
@@ -0,0 +1,222 @@
+#ifndef SSS_COMMONS_LOCKFREE_HPP
+#define SSS_COMMONS_LOCKFREE_HPP
+
+#include "_includes.hpp"
+
+/** @file
+ *  Defines lock-free containers used across the library.
+ */
+
+SSS_BEGIN;
+
+/** Size, in bytes, used to keep hot atomics on separate cache lines.*/
+inline constexpr std::size_t cache_line_size = 64;
+
+/** Bounded, lock-free, multi-producer multi-consumer queue.
+ *
+ *  Each cell holds a sequence number which tells producers and
+ *  consumers whether the cell is free or filled, so that neither
+ *  side ever takes a lock (Dmitry Vyukov's bounded queue).
+ *
+ *  @param[in] T The stored type, which needs to be default
+ *  constructible and move assignable.
+ */
+template <typename T>
+class RingQueue {
+public:
+    /** Constructor, allocates all cells at once.
+     *  @param[in] capacity The maximum number of stored elements,
+     *  rounded up to the next power of two.
+     */
+    explicit RingQueue(std::size_t capacity)
+        : _mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+        _cells(std::make_unique<_Cell[]>(_mask + 1))
+    {
+        for (std::size_t i = 0; i <= _mask; ++i) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    };
+    RingQueue(RingQueue const&) = delete;
+    RingQueue(RingQueue&&) = delete;
+
+    /** Moves the given value in the queue.
+     *  @return \c true if the value was pushed, and \c false
+     *  if the queue was full (in which case \c value is untouched).
+     */
+    bool tryPush(T& value)
+    {
+        std::size_t pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            _Cell& cell = _cells[pos & _mask];
+            std::size_t const seq = cell.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t const diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /** Moves the oldest value of the queue in given reference.
+     *  @return \c true if a value was popped, and \c false
+     *  if the queue was empty.
+     */
+    bool tryPop(T& value)
+    {
+        std::size_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            _Cell& cell = _cells[pos & _mask];
+            std::size_t const seq = cell.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t const diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.seq.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /** Returns the maximum number of stored elements.*/
+    inline std::size_t capacity() const noexcept { return _mask + 1; };
+    /** Returns an approximation of the number of stored elements.*/
+    inline std::size_t size() const noexcept {
+        std::size_t const head = _head.load(std::memory_order_relaxed);
+        std::size_t const tail = _tail.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    };
+    /** Returns \c true if the queue seems empty.*/
+    inline bool empty() const noexcept { return size() == 0; };
+
+private:
+    struct alignas(cache_line_size) _Cell {
+        std::atomic<std::size_t> seq;
+        T value{};
+    };
+
+    std::size_t const _mask;
+    std::unique_ptr<_Cell[]> _cells;
+    alignas(cache_line_size) std::atomic<std::size_t> _head{ 0 };
+    alignas(cache_line_size) std::atomic<std::size_t> _tail{ 0 };
+};
+
+/** Lock-free histogram of unsigned values (e.g. durations in ns).
+ *
+ *  Values are counted in power of two buckets: bucket \c i holds values
+ *  of bit width \c i, that is [2^(i-1), 2^i - 1], bucket 0 holding 0.
+ *  Recording is a few relaxed atomic operations, so that any
+ *  number of threads may record at once without contention on a lock.
+ */
+class Histogram {
+public:
+    /** Number of buckets, one per possible bit width.*/
+    static constexpr std::size_t bucket_count = 65;
+
+    /** Copy of a histogram's values at a given time.*/
+    struct Snapshot {
+        /** Number of recorded values.*/
+        std::uint64_t count{ 0 };
+        /** Sum of recorded values.*/
+        std::uint64_t sum{ 0 };
+        /** Lowest recorded value, 0 if none.*/
+        std::uint64_t min{ 0 };
+        /** Highest recorded value, 0 if none.*/
+        std::uint64_t max{ 0 };
+        /** Number of values per bucket.*/
+        std::uint64_t buckets[bucket_count]{};
+
+        /** Returns the mean of recorded values, 0 if none.*/
+        inline double mean() const noexcept {
+            return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+        };
+        /** Returns an upper bound of the given percentile, precise
+         *  within a factor of two (the bucket's upper bound).
+         *  @param[in] p The percentile, in [0, 1] (e.g. 0.99).
+         */
+        std::uint64_t percentile(double p) const noexcept
+        {
+            if (count == 0) {
+                return 0;
+            }
+            std::uint64_t const rank = std::max<std::uint64_t>(1,
+                static_cast<std::uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * static_cast<double>(count))));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < bucket_count; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) {
+                    std::uint64_t const upper = i == 0 ? 0
+                        : i == 64 ? UINT64_MAX : (std::uint64_t(1) << i) - 1;
+                    return std::clamp(upper, min, max);
+                }
+            }
+            return max;
+        };
+    };
+
+    /** Records the given value.*/
+    void record(std::uint64_t value) noexcept
+    {
+        _buckets[std::bit_width(value)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+        std::uint64_t min = _min.load(std::memory_order_relaxed);
+        while (value < min && !_min.compare_exchange_weak(min, value, std::memory_order_relaxed));
+        std::uint64_t max = _max.load(std::memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+    };
+
+    /** Returns a copy of the recorded values. Values recorded
+     *  meanwhile may or may not be part of it.
+     */
+    Snapshot snapshot() const noexcept
+    {
+        Snapshot snapshot;
+        snapshot.count = _count.load(std::memory_order_relaxed);
+        snapshot.sum = _sum.load(std::memory_order_relaxed);
+        snapshot.min = snapshot.count == 0 ? 0 : _min.load(std::memory_order_relaxed);
+        snapshot.max = _max.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    };
+
+    /** Forgets all recorded values.*/
+    void reset() noexcept
+    {
+        for (std::atomic<std::uint64_t>& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        _count.store(0, std::memory_order_relaxed);
+        _sum.store(0, std::memory_order_relaxed);
+        _min.store(UINT64_MAX, std::memory_order_relaxed);
+        _max.store(0, std::memory_order_relaxed);
+    };
+
+private:
+    std::atomic<std::uint64_t> _buckets[bucket_count]{};
+    std::atomic<std::uint64_t> _count{ 0 };
+    std::atomic<std::uint64_t> _sum{ 0 };
+    std::atomic<std::uint64_t> _min{ UINT64_MAX };
+    std::atomic<std::uint64_t> _max{ 0 };
+};
+
+SSS_END;
+
+#endif // SSS_COMMONS_LOCKFREE_HPP
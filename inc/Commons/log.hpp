@@ -4,6 +4,7 @@
 #include "_includes.hpp"
 #include "time.hpp"
 #include "conversions.hpp"
+#include "lockfree.hpp"
 
 /** @file
  *  Defines log functions, constants, template class, and numerous macros.
@@ -11,8 +12,9 @@
 
 SSS_BEGIN;
 
-/** Writes the given string to \c std::cout
+/** Writes the given string to all log sinks (\c std::cout by default).
  *  @param[in] str The string to write to \c std::cout
+ *  @sa Log::addSink()
  */
 SSS_COMMONS_API void log_msg(std::string const& str) noexcept;
 /** Converts the given argument of type \c T via \c SSS::toString
@@ -22,8 +24,10 @@ SSS_COMMONS_API void log_msg(std::string const& str) noexcept;
 template <typename T>
 inline void log_msg(T const& arg) noexcept { log_msg(toString(arg)); }
 
-/** Writes the given string to \c std::cerr with a warning notice.
+/** Writes the given string to all log sinks (\c std::cerr by default)
+ *  with a warning notice.
  *  @param[in] str The string to write to \c std::cerr
+ *  @sa Log::addSink()
  */
 SSS_COMMONS_API void log_wrn(std::string const& str) noexcept;
 /** Converts the given argument of type \c T via \c SSS::toString
@@ -33,8 +37,10 @@ SSS_COMMONS_API void log_wrn(std::string const& str) noexcept;
 template <typename T>
 inline void log_wrn(T const& arg) noexcept { log_wrn(toString(arg)); }
 
-/** Writes the given string to \c std::cerr with an error notice.
+/** Writes the given string to all log sinks (\c std::cerr by default)
+ *  with an error notice.
  *  @param[in] str The string to write to \c std::cerr.
+ *  @sa Log::addSink()
  */
 SSS_COMMONS_API void log_err(std::string const& str) noexcept;
 /** Converts the given argument of type \c T via \c SSS::toString
@@ -56,6 +62,82 @@ SSS_COMMONS_API std::string getErrorString(int errnum);
  */
 SSS_COMMONS_API NO_RETURN void throw_exc(std::string const& str);
 
+namespace Log {
+    INTERNAL_BEGIN;
+    /** Holds the silenced & loudened states of every log structure.
+     *  Each SSS::LogBase derived structure is given a slot of two bits
+     *  in cache-line-aligned atomic words. These bits already combine
+     *  the states of all parent namespaces, so that a query costs a
+     *  single relaxed load and a mask test. They are recomputed under
+     *  a lock whenever a state is toggled.
+     */
+    class SSS_COMMONS_API Registry {
+    public:
+        /** Maximum number of log structures.*/
+        static constexpr std::size_t max_slots = 256;
+        /** Slot given as parent to root structures.*/
+        static constexpr std::size_t no_parent = SIZE_MAX;
+        /** Slot of structures which weren't given one yet.*/
+        static constexpr std::size_t unallocated = SIZE_MAX - 1;
+
+        /** Gives a slot to a new log structure, which inherits the
+         *  states of the given parent slot, and stores it in \c slot
+         *  unless another thread did meanwhile.
+         *  If all slots are taken, logs an error and shares the slot
+         *  of the parent (or of the first structure) instead.
+         *  @return The slot stored in \c slot.
+         */
+        static std::size_t allocate(std::atomic<std::size_t>& slot, std::size_t parent) noexcept;
+        /** Sets the own silenced state of given slot.*/
+        static void silence(std::size_t slot, bool state);
+        /** Sets the own loudened state of given slot.*/
+        static void louden(std::size_t slot, bool state);
+
+        /** Returns \c true if given slot or any of its parents is silenced.*/
+        static bool isSilenced(std::size_t slot) noexcept { return _bits(slot) & silenced_bit; };
+        /** Returns \c true if given slot or any of its parents is loudened.*/
+        static bool isLoudened(std::size_t slot) noexcept { return _bits(slot) & loudened_bit; };
+        /** Returns \c false if silenced, \c true if loudened, and the given flag otherwise.*/
+        static bool query(std::size_t slot, bool flag) noexcept {
+            std::uint64_t const bits = _bits(slot);
+            return !(bits & silenced_bit) && ((bits & loudened_bit) || flag);
+        };
+
+    private:
+        static constexpr std::size_t slots_per_word = 32;
+        static constexpr std::uint64_t silenced_bit = 1;
+        static constexpr std::uint64_t loudened_bit = 2;
+
+        struct alignas(cache_line_size) _Word {
+            std::atomic<std::uint64_t> value{ 0 };
+        };
+        static _Word _words[max_slots / slots_per_word];
+
+        static std::uint64_t _bits(std::size_t slot) noexcept {
+            return _words[slot / slots_per_word].value.load(std::memory_order_relaxed)
+                >> (2 * (slot % slots_per_word));
+        };
+        static void _set(std::size_t slot, std::uint64_t bit, bool state);
+    };
+    INTERNAL_END;
+
+    /** Flag of log structures, which may be toggled from any
+     *  thread while others query it (relaxed atomic operations).
+     */
+    class Flag {
+    public:
+        constexpr Flag(bool state = false) noexcept : _state(state) {};
+        Flag(Flag const&) = delete;
+        Flag& operator=(bool state) noexcept {
+            _state.store(state, std::memory_order_relaxed);
+            return *this;
+        };
+        operator bool() const noexcept { return _state.load(std::memory_order_relaxed); };
+    private:
+        std::atomic<bool> _state;
+    };
+}
+
 /** Singleton template class to be inherited by log structures.
  *  %Log structures are intended to be nested in the Log (or
  *  subsequent) namespace and access its data with the
@@ -66,8 +148,8 @@ SSS_COMMONS_API NO_RETURN void throw_exc(std::string const& str);
  *  namespace SSS::Log {
  *      struct Example : SSS::LogBase<Example> {
  *          using LOG_STRUCT_BASICS(Log, Example);
- *          bool foo = false;
- *          bool bar = false;
+ *          SSS::Log::Flag foo = false;
+ *          SSS::Log::Flag bar = false;
  *      }
  *  }
  *  @endcode
@@ -79,9 +161,8 @@ protected:
     // Hide constructor & destructor
     LogBase() = default;
     ~LogBase() = default;
-    // Share declarations between derived classes without sharing actual data 
-    bool _silence = false;
-    bool _louden = false;
+    // Slot of the parent structure, redefined by LOG_STRUCT_BASICS
+    static std::size_t _parentSlot() { return Log::_internal::Registry::no_parent; };
     /** \endcond*/
 public:
     /** Returns the singleton instance (lazy instantiation pattern).*/
@@ -89,30 +170,47 @@ public:
         static T instance;
         return instance;
     };
+    /** Returns the slot of this structure in Log::_internal::Registry.*/
+    static std::size_t slot() noexcept {
+        std::size_t const slot = _slot.load(std::memory_order_acquire);
+        if (slot != Log::_internal::Registry::unallocated) {
+            return slot;
+        }
+        // Instantiates _registered, so that slots are allocated at load time
+        static_cast<void>(_registered);
+        return Log::_internal::Registry::allocate(_slot, T::_parentSlot());
+    };
     /** Sets the silenced mode state to \c true or \c false.
      *  In silenced mode, all subsequent log flags act as if
      *  they were set to \c false without actually changing
      *  their value.
      */
-    static void silence(bool state) { get()._silence = state; };
+    static void silence(bool state) { Log::_internal::Registry::silence(slot(), state); };
     /** Sets the loudened mode state to \c true or \c false.
      *  In loudened mode, all subsequent log flags act as if
      *  they were set to \c true without actually changing
      *  their value.
      */
-    static void louden(bool state) { get()._louden = state; };
+    static void louden(bool state) { Log::_internal::Registry::louden(slot(), state); };
     /** Returns \c true if silenced mode is active in any parent
      *  namespace or in this structure, and \c false otherwise.
      */
-    static bool isSilenced() { return get()._silence; };
+    static bool isSilenced() { return Log::_internal::Registry::isSilenced(slot()); };
     /** Returns \c true if loudened mode is active in any parent
      *  namespace or in this structure, and \c false otherwise.
      */
-    static bool isLoudened() { return get()._louden; };
+    static bool isLoudened() { return Log::_internal::Registry::isLoudened(slot()); };
     /** Returns \c false if silenced mode is active, \c true if
      *  loudened mode is active, and the given flag otherwise.
+     *  Costs a single relaxed atomic load, and can be called from any thread.
      */
-    static bool query(bool flag) { return !isSilenced() && (isLoudened() || flag); };
+    static bool query(bool flag) { return Log::_internal::Registry::query(slot(), flag); };
+private:
+    // Allocated when the module loads, or by the first slot() call if
+    // queried earlier during static initialization, as the order of
+    // those isn't specified. Parents are allocated first by slot().
+    inline static std::atomic<std::size_t> _slot{ Log::_internal::Registry::unallocated };
+    inline static bool const _registered = (slot(), true);
 };
 
 /** Base namespace for all subsequent log namespaces and structures.
@@ -144,14 +242,240 @@ namespace Log {
     SSS_COMMONS_API inline bool isLoudened() { return _internal::Base::isLoudened(); };
     /** Handle to the internal instance's LogBase::isSilenced() function.*/
     SSS_COMMONS_API inline bool isSilenced() { return _internal::Base::isSilenced(); };
+
+    /** Levels of log messages.*/
+    enum class Level : std::uint8_t {
+        msg,    /**< Logged via SSS::log_msg().*/
+        wrn,    /**< Logged via SSS::log_wrn().*/
+        err     /**< Logged via SSS::log_err().*/
+    };
+
+    /** Behavior of asynchronous logging when its queue is full.
+     *  @sa enableAsync()
+     */
+    enum class Overflow {
+        /** The logging thread waits for the writer to free a slot.*/
+        block,
+        /** The new message is discarded.*/
+        drop_newest,
+        /** The oldest queued message is discarded.*/
+        drop_oldest
+    };
+
+    /** Enables asynchronous logging.
+     *  Once enabled, SSS::log_msg(), SSS::log_wrn() and SSS::log_err()
+     *  push their message in a lock-free queue, and a dedicated writer
+     *  thread formats, batches and flushes them.
+     *  @param[in] capacity The maximum number of queued messages. Only
+     *  taken into account the first time this function is called.
+     *  @param[in] policy What to do when the queue is full.
+     *  @sa disableAsync(), flush()
+     */
+    SSS_COMMONS_API void enableAsync(std::size_t capacity = 8192, Overflow policy = Overflow::block);
+    /** Disables asynchronous logging, after having written all queued messages.
+     *  @sa enableAsync()
+     */
+    SSS_COMMONS_API void disableAsync() noexcept;
+    /** Returns \c true if asynchronous logging is enabled.*/
+    SSS_COMMONS_API bool isAsync() noexcept;
+    /** Returns the number of messages discarded due to the Overflow policy.*/
+    SSS_COMMONS_API std::size_t droppedCount() noexcept;
+    /** Writes all queued messages from the calling thread, then flushes streams.
+     *  Meant for shutdown and crash paths, can be called at any time.
+     */
+    SSS_COMMONS_API void flush() noexcept;
+
+    /** In-memory ring of the most recent log messages.
+     *
+     *  Once enabled, every message given to SSS::log_msg(), SSS::log_wrn()
+     *  and SSS::log_err() is also copied in a fixed-size, lock-free ring,
+     *  truncated to #max_length characters. The ring can be dumped on
+     *  demand, and automatically whenever an error is logged (which
+     *  includes exceptions caught by SSS::Async) or thrown via
+     *  SSS::throw_exc().
+     *
+     *  With captureSilenced(), messages guarded by #LOG_IF are captured
+     *  even when their category is silenced or their flag is off,
+     *  without being written anywhere else.
+     */
+    class SSS_COMMONS_API FlightRecorder {
+    public:
+        /** Maximum length of a captured message, longer ones are truncated.*/
+        static constexpr std::size_t max_length = 232;
+
+        /** Starts capturing messages.
+         *  @param[in] capacity The number of messages kept, rounded up
+         *  to the next power of two. Only taken into account the first
+         *  time this function is called.
+         */
+        static void enable(std::size_t capacity = 1024);
+        /** Stops capturing messages, already captured ones are kept.*/
+        static void disable() noexcept;
+        /** Returns \c true if messages are being captured.*/
+        static bool isEnabled() noexcept;
+
+        /** Sets whether messages guarded by #LOG_IF should be captured
+         *  even if the guard fails. Their arguments are then evaluated.
+         */
+        static void captureSilenced(bool state) noexcept;
+        /** Returns \c true if enabled and capturing guarded messages.*/
+        static bool capturesSilenced() noexcept {
+            return _capture_silenced.load(std::memory_order_relaxed);
+        };
+        /** Sets whether the ring should be dumped to all sinks when
+         *  an error is logged (right before the error itself) or thrown.
+         *  Defaults to \c true.
+         */
+        static void dumpOnError(bool state) noexcept;
+
+        /** Writes all messages captured since the last dump, oldest
+         *  first, to all sinks as a single error-level block.
+         *  @sa addSink()
+         */
+        static void dump() noexcept;
+        /** Writes all messages captured since the last dump, oldest first.
+         *  @param[out] stream The stream to write the messages to.
+         */
+        static void dump(std::ostream& stream) noexcept;
+
+    private:
+        static std::atomic<bool> _capture_silenced;
+    };
 }
 
+INTERNAL_BEGIN;
+
+// Guard of #LOG_IF, lets messages reach the flight recorder only
+// when the guard fails but silenced messages should be captured
+class SSS_COMMONS_API LogGuard {
+public:
+    explicit LogGuard(bool enabled) noexcept
+        : _enabled(enabled), _record_only(!enabled && Log::FlightRecorder::capturesSilenced())
+    {
+        if (_record_only) _recordOnly(true);
+    };
+    ~LogGuard() { if (_record_only) _recordOnly(false); };
+    LogGuard(LogGuard const&) = delete;
+    explicit operator bool() const noexcept { return _enabled || _record_only; };
+private:
+    static void _recordOnly(bool state) noexcept;
+    bool const _enabled;
+    bool const _record_only;
+};
+
+// Per call site state of rate limited macros, see #LOG_EVERY_N & co.
+// Denied calls are counted, and the count is handed to the first allowed
+// call of the next window, or of the next N calls.
+class RateLimiter {
+public:
+    struct Decision {
+        bool allowed;
+        std::uint64_t suppressed;
+    };
+
+    Decision once() noexcept
+    {
+        if (_calls.fetch_add(1, std::memory_order_relaxed) == 0) {
+            return { true, 0 };
+        }
+        return { false, 0 };
+    };
+
+    Decision everyN(std::uint64_t n) noexcept
+    {
+        if (n <= 1 || _calls.fetch_add(1, std::memory_order_relaxed) % n == 0) {
+            return _allow();
+        }
+        return _deny();
+    };
+
+    Decision everyMS(long long ms) noexcept
+    {
+        long long const now = monotonicNS();
+        long long last = _window_start.load(std::memory_order_relaxed);
+        if ((last == never || now - last >= ms * 1'000'000)
+            && _window_start.compare_exchange_strong(last, now, std::memory_order_relaxed))
+        {
+            return _allow();
+        }
+        return _deny();
+    };
+
+    Decision rate(std::uint64_t count, long long ms) noexcept
+    {
+        long long const now = monotonicNS();
+        long long start = _window_start.load(std::memory_order_relaxed);
+        if ((start == never || now - start >= ms * 1'000'000)
+            && _window_start.compare_exchange_strong(start, now, std::memory_order_relaxed))
+        {
+            _calls.store(0, std::memory_order_relaxed);
+        }
+        if (_calls.fetch_add(1, std::memory_order_relaxed) < count) {
+            return _allow();
+        }
+        return _deny();
+    };
+
+private:
+    static constexpr long long never = std::numeric_limits<long long>::min();
+
+    inline Decision _allow() noexcept {
+        return { true, _suppressed.exchange(0, std::memory_order_relaxed) };
+    };
+    inline Decision _deny() noexcept {
+        _suppressed.fetch_add(1, std::memory_order_relaxed);
+        return { false, 0 };
+    };
+
+    std::atomic<std::uint64_t> _calls{ 0 };
+    std::atomic<std::uint64_t> _suppressed{ 0 };
+    std::atomic<long long> _window_start{ never };
+};
+
+// Guard of rate limited macros, logs how many calls of its site were
+// suppressed on its own line, whether the guarded statement logs or not
+class SSS_COMMONS_API RateGuard {
+public:
+    RateGuard(RateLimiter::Decision decision, char const* file, int line) noexcept
+        : _allowed(decision.allowed)
+    {
+        if (decision.suppressed != 0) _logSuppressed(decision.suppressed, file, line);
+    };
+    RateGuard(RateGuard const&) = delete;
+    explicit operator bool() const noexcept { return _allowed; };
+private:
+    static void _logSuppressed(std::uint64_t count, char const* file, int line) noexcept;
+    bool const _allowed;
+};
+
+// Returns "Class [0xADDRESS]", used by #THIS_OBJ
+inline std::string objName(std::type_info const& info, void const* ptr)
+{
+    std::string ret(typeName(info));
+    ret += " [0x";
+    toString(ret, ptr);
+    ret += ']';
+    return ret;
+};
+
+// Returns "Class::function()", used by #METHOD
+inline std::string methodName(std::type_info const& info, char const* func)
+{
+    std::string ret(typeName(info));
+    ret += "::";
+    ret += func;
+    ret += "()";
+    return ret;
+};
+
+INTERNAL_END;
+
 SSS_END;
 
 /** To be included in SSS::LogBase derived classes.
  *  Hides constructor and destructor to enforce singleton pattern.\n
  *  Declares parent class as friend to allow constructor to be called.\n
- *  Re-defines namespace dependent functions.
+ *  Links the structure to its namespace's slot in the log registry.
  *  @param Namespace The namespace the struct is being nested into.
  *  @param Struct The struct name itself.
  */
@@ -161,10 +485,8 @@ SSS_END;
 private:\
     Struct() = default;\
     ~Struct() = default;\
-public:\
-    static bool isSilenced() { return Namespace::isSilenced() || get()._silence; };\
-    static bool isLoudened() { return Namespace::isLoudened() || get()._louden; };\
-    static bool query(bool flag) { return !isSilenced() && (isLoudened() || flag); };
+    static std::size_t _parentSlot() { return Namespace::_internal::Base::slot(); };\
+public:
 
 /** To be included in any subsequent SSS::Log namespace.
  *  Defines internal SSS::LogBase instance and handles to its functions.
@@ -182,24 +504,24 @@ inline bool isSilenced() { return _internal::Base::isSilenced(); };\
 inline bool isLoudened() { return _internal::Base::isLoudened(); };
 
 /** Adds ": " between the "cxt" and "msg" strings.*/
-#define CONTEXT_MSG(cxt, msg) (SSS::toString(cxt) + ": " + SSS::toString(msg))
+#define CONTEXT_MSG(cxt, msg) SSS::contextMsg(cxt, msg)
 
 /** Current scope's function name.*/
 #define FUNC (std::string(__func__) + "()")
 /** Prepends <tt>'#FUNC: '</tt> to the given string.*/
 #define FUNC_MSG(X) CONTEXT_MSG(FUNC, X)
 
-/** Current scope's class name.*/
-#define THIS_NAME (std::string(typeid(*this).name() + 6))
+/** Current scope's class name, as a \c std::string_view (see SSS::typeName()).*/
+#define THIS_NAME SSS::typeName(typeid(*this))
 /** Current scope's instance address.*/
-#define THIS_ADDR std::string("0x") + SSS::toString(this)
+#define THIS_ADDR (std::string("0x") + SSS::toString(this))
 /** Current scope's class name & instance address.*/
-#define THIS_OBJ THIS_NAME + " [" + THIS_ADDR + "]"
+#define THIS_OBJ SSS::_internal::objName(typeid(*this), this)
 /** Prepends <tt>'#THIS_OBJ: '</tt> to the given string.*/
 #define OBJ_MSG(X) CONTEXT_MSG(THIS_OBJ, X)
 
 /** Current scope's method's name.*/
-#define METHOD (THIS_NAME + "::" + FUNC)
+#define METHOD SSS::_internal::methodName(typeid(*this), __func__)
 /** Prepends <tt>'#METHOD: '</tt> to the given string.*/
 #define METHOD_MSG(X) CONTEXT_MSG(METHOD, X)
 /** Current scope's instance address & method's name.*/
@@ -207,12 +529,96 @@ inline bool isLoudened() { return _internal::Base::isLoudened(); };
 /** Prepends <tt>'#OBJ_METHOD: '</tt> to the given string.*/
 #define OBJ_METHOD_MSG(X) CONTEXT_MSG(OBJ_METHOD, X)
 
-/** Calls \c SSS::log_msg only in debug mode.*/
-#define LOG_MSG(X)    SSS::log_msg( X );
-/** Calls \c SSS::log_wrn only in debug mode.*/
-#define LOG_WRN(X)    SSS::log_wrn( X );
-/** Calls \c SSS::log_err only in debug mode.*/
-#define LOG_ERR(X)    SSS::log_err( X );
+/** Level of messages logged via \c SSS::log_msg.*/
+#define SSS_LOG_LEVEL_MSG   0
+/** Level of messages logged via \c SSS::log_wrn.*/
+#define SSS_LOG_LEVEL_WRN   1
+/** Level of messages logged via \c SSS::log_err.*/
+#define SSS_LOG_LEVEL_ERR   2
+/** Level above all others, compiles every \c LOG_* macro out.*/
+#define SSS_LOG_LEVEL_NONE  3
+
+#ifndef SSS_LOG_LEVEL
+/** Minimum level of \c LOG_* macros kept at compile time.
+ *  Define it before including this header (e.g. to
+ *  #SSS_LOG_LEVEL_WRN in release builds) to compile lower
+ *  levels out: their arguments are then never evaluated.
+ */
+#define SSS_LOG_LEVEL SSS_LOG_LEVEL_MSG
+#endif // SSS_LOG_LEVEL
+
+// Discards the following statement at compile time if the given
+// level is below #SSS_LOG_LEVEL, so that it evaluates nothing
+#define SSS_LOG_AT_(Level) if constexpr (SSS_LOG_LEVEL > Level) {} else
+
+/** Calls \c SSS::log_msg unless compiled out by #SSS_LOG_LEVEL.*/
+#define LOG_MSG(X)    SSS_LOG_AT_(SSS_LOG_LEVEL_MSG) SSS::log_msg( X );
+/** Calls \c SSS::log_wrn unless compiled out by #SSS_LOG_LEVEL.*/
+#define LOG_WRN(X)    SSS_LOG_AT_(SSS_LOG_LEVEL_WRN) SSS::log_wrn( X );
+/** Calls \c SSS::log_err unless compiled out by #SSS_LOG_LEVEL.*/
+#define LOG_ERR(X)    SSS_LOG_AT_(SSS_LOG_LEVEL_ERR) SSS::log_err( X );
+
+/** Evaluates the following statement only if the given flag of the
+ *  given log structure is queried \c true, see SSS::LogBase::query().
+ *  Arguments of the guarded \c LOG_* macro are not evaluated otherwise,
+ *  unless SSS::Log::FlightRecorder::captureSilenced() was set.
+ *  @usage
+ *  @code
+ *  LOG_IF(SSS::Log::Async, run_state) LOG_OBJ_MSG("Function started running.");
+ *  @endcode
+ */
+#define LOG_IF(Struct, Flag) \
+    if (SSS::_internal::LogGuard const _sss_log_guard{ Struct::query(Struct::get().Flag) }; \
+        !_sss_log_guard) {} else
+
+/** #LOG_IF guarding a message level statement, compiled out along
+ *  with the query when #SSS_LOG_LEVEL discards messages.
+ *  @usage
+ *  @code
+ *  LOG_IF_MSG(SSS::Log::Async, run_state) LOG_OBJ_MSG("Function started running.");
+ *  @endcode
+ */
+#define LOG_IF_MSG(Struct, Flag) SSS_LOG_AT_(SSS_LOG_LEVEL_MSG) LOG_IF(Struct, Flag)
+/** #LOG_IF guarding a warning level statement, see #LOG_IF_MSG.*/
+#define LOG_IF_WRN(Struct, Flag) SSS_LOG_AT_(SSS_LOG_LEVEL_WRN) LOG_IF(Struct, Flag)
+/** #LOG_IF guarding an error level statement, see #LOG_IF_MSG.*/
+#define LOG_IF_ERR(Struct, Flag) SSS_LOG_AT_(SSS_LOG_LEVEL_ERR) LOG_IF(Struct, Flag)
+
+// Evaluates the following statement if the given call on
+// a per call site RateLimiter allows it
+#define SSS_LOG_RATE_LIMITED_(Call) \
+    if (SSS::_internal::RateGuard const _sss_rate_guard{ []() -> SSS::_internal::RateLimiter& { \
+            static SSS::_internal::RateLimiter limiter; return limiter; }().Call, __FILE__, __LINE__ }; \
+        !_sss_rate_guard) {} else
+
+/** Evaluates the following statement only the first time this call site is reached.
+ *  @usage
+ *  @code
+ *  LOG_ONCE LOG_WRN("Deprecated function, use bar() instead.");
+ *  @endcode
+ */
+#define LOG_ONCE SSS_LOG_RATE_LIMITED_(once())
+/** Evaluates the following statement once every \c N times this call
+ *  site is reached, starting with the first.
+ *  Each time the statement is allowed again, a warning reports how many
+ *  calls of the site were suppressed since, on its own line, such as
+ *  "file.cpp:42: suppressed 12,345 similar messages". There is no timer:
+ *  suppressed calls of a site which isn't reached anymore aren't reported.\n
+ *  Arguments of the guarded \c LOG_* macro are not evaluated otherwise.
+ *  @usage
+ *  @code
+ *  LOG_EVERY_N(1000) LOG_OBJ_WRN("Queue is full.");
+ *  @endcode
+ */
+#define LOG_EVERY_N(N) SSS_LOG_RATE_LIMITED_(everyN(N))
+/** Evaluates the following statement at most once every \c MS
+ *  milliseconds at this call site, see #LOG_EVERY_N.
+ */
+#define LOG_EVERY_MS(MS) SSS_LOG_RATE_LIMITED_(everyMS(MS))
+/** Evaluates the following statement at most \c N times every \c MS
+ *  milliseconds at this call site, see #LOG_EVERY_N.
+ */
+#define LOG_RATE_LIMITED(N, MS) SSS_LOG_RATE_LIMITED_(rate(N, MS))
 
 #define LOG_CTX_MSG(X, Y)   LOG_MSG ( CONTEXT_MSG(X, Y) );
 #define LOG_CTX_WRN(X, Y)   LOG_WRN ( CONTEXT_MSG(X, Y) );
@@ -0,0 +1,234 @@
+#ifndef SSS_COMMONS_LOGSINK_HPP
+#define SSS_COMMONS_LOGSINK_HPP
+
+#include "_includes.hpp"
+#include "log.hpp"
+
+/** @file
+ *  Defines the log sink interface, and its built-in implementations.
+ */
+
+SSS_BEGIN;
+
+// Ignore warning about STL exports as they're private members
+#pragma warning(push, 2)
+#pragma warning(disable: 4251)
+#pragma warning(disable: 4275)
+
+namespace Log {
+    /** Destination of log lines.
+     *
+     *  Each message is formatted once as a full line (time stamp,
+     *  level notice, message and line break), then handed to every
+     *  registered sink whose level filter accepts it.
+     *  Sinks serialize their own writes, and may buffer lines
+     *  until flushed as dictated by their #Flush policy.
+     *
+     *  @usage
+     *  @code
+     *  auto file = std::make_shared<SSS::Log::FileSink>("game.log");
+     *  file->setFlush(SSS::Log::Sink::Flush::error);
+     *  SSS::Log::addSink(file);
+     *  SSS::Log::consoleSink()->setLevel(SSS::Log::Level::wrn);
+     *  @endcode
+     *  @sa addSink(), removeSink()
+     */
+    class SSS_COMMONS_API Sink {
+    public:
+        /** When a sink flushes its buffered lines.*/
+        enum class Flush {
+            /** After every line.*/
+            line,
+            /** After every batch of lines: every line when logging
+             *  synchronously, every wake of the writer thread otherwise.
+             */
+            batch,
+            /** After error lines only.*/
+            error,
+            /** Only when its buffer is full, or on SSS::Log::flush().*/
+            manual
+        };
+
+        /** Constructor, sets the level filter and flush policy.*/
+        explicit Sink(Level level = Level::msg, Flush flush = Flush::batch) noexcept;
+        /** Destructor, does \b not flush, which is up to derived classes.*/
+        virtual ~Sink();
+        Sink(Sink const&) = delete;
+        Sink& operator=(Sink const&) = delete;
+
+        /** Sets the minimum level of accepted lines.*/
+        inline void setLevel(Level level) noexcept { _level.store(level, std::memory_order_relaxed); };
+        /** Returns the minimum level of accepted lines.*/
+        inline Level getLevel() const noexcept { return _level.load(std::memory_order_relaxed); };
+        /** Returns \c true if lines of given level are accepted.*/
+        inline bool accepts(Level level) const noexcept { return level >= getLevel(); };
+        /** Sets the flush policy.*/
+        inline void setFlush(Flush flush) noexcept { _flush_policy.store(flush, std::memory_order_relaxed); };
+        /** Returns the flush policy.*/
+        inline Flush getFlush() const noexcept { return _flush_policy.load(std::memory_order_relaxed); };
+
+        /** Writes the given line if accepted, then flushes as per policy.
+         *  @param[in] level The level of the line.
+         *  @param[in] line The formatted line, line break included.
+         *  @param[in] batch_end Whether the line ends a batch, see endBatch().
+         */
+        void write(Level level, std::string_view line, bool batch_end = true) noexcept;
+        /** Signals the end of a batch of lines.*/
+        void endBatch() noexcept;
+        /** Writes all buffered lines.*/
+        void flush() noexcept;
+
+    protected:
+        /** Writes or buffers the given line, called with the sink locked.*/
+        virtual void _write(Level level, std::string_view line) = 0;
+        /** Writes all buffered lines, called with the sink locked.*/
+        virtual void _flush() {};
+
+    private:
+        std::atomic<Level> _level;
+        std::atomic<Flush> _flush_policy;
+        std::mutex _mutex;
+        bool _dirty{ false };
+    };
+
+    /** Writes messages to \c std::cout, and warnings & errors to \c std::cerr.
+     *  An instance is registered by default, see consoleSink().
+     */
+    class SSS_COMMONS_API ConsoleSink : public Sink {
+    public:
+        /** Constructor, see Sink::Sink().*/
+        explicit ConsoleSink(Level level = Level::msg, Flush flush = Flush::batch) noexcept;
+        /** Destructor, flushes buffered lines.*/
+        ~ConsoleSink();
+    protected:
+        void _write(Level level, std::string_view line) override;
+        void _flush() override;
+    private:
+        // Buffered lines, written in order as runs of lines sharing a stream
+        struct _Run {
+            bool err;
+            std::size_t end;
+        };
+        std::string _buffer;
+        std::vector<_Run> _runs;
+    };
+
+    /** Writes lines to a file, through a large buffer.*/
+    class SSS_COMMONS_API FileSink : public Sink {
+    public:
+        /** Opens the given file.
+         *  @param[in] path The path of the file to write to.
+         *  @param[in] append Whether to keep the existing content, or truncate it.
+         *  @param[in] buffer_size The size lines are buffered up to
+         *  before being written, regardless of the #Flush policy.
+         *  @throws std::runtime_error If the file couldn't be opened.
+         */
+        explicit FileSink(std::filesystem::path path, bool append = false,
+            std::size_t buffer_size = 1 << 16);
+        /** Destructor, flushes buffered lines.*/
+        ~FileSink();
+        /** Returns the path of the written file.*/
+        inline std::filesystem::path const& getPath() const noexcept { return _path; };
+    protected:
+        void _write(Level level, std::string_view line) override;
+        void _flush() override;
+        /** (Re)opens the file, called with the sink locked.*/
+        void _open(bool append);
+        /** Flushes then closes the file, called with the sink locked.*/
+        void _close();
+        /** Returns the number of bytes written to the file, buffer included.*/
+        inline std::uintmax_t _fileSize() const noexcept { return _size; };
+    private:
+        std::filesystem::path const _path;
+        std::size_t const _buffer_size;
+        std::ofstream _file;
+        std::string _buffer;
+        std::uintmax_t _size{ 0 };
+    };
+
+    /** FileSink which rotates its file once too big or too old.
+     *
+     *  When rotating, \c "name.ext" is renamed \c "name.1.ext", the
+     *  previous \c "name.1.ext" is renamed \c "name.2.ext", and so on
+     *  up to the maximum number of kept files.
+     */
+    class SSS_COMMONS_API RotatingFileSink : public FileSink {
+    public:
+        /** Opens the given file, truncating it.
+         *  @param[in] path The path of the file to write to.
+         *  @param[in] max_size The size (in bytes) above which the
+         *  file is rotated, zero meaning no limit.
+         *  @param[in] max_age The duration after which the file is
+         *  rotated, zero meaning no limit.
+         *  @param[in] max_files The number of rotated files kept.
+         *  @throws std::runtime_error If the file couldn't be opened.
+         */
+        RotatingFileSink(std::filesystem::path path, std::uintmax_t max_size,
+            std::chrono::seconds max_age = std::chrono::seconds(0), std::size_t max_files = 5);
+    protected:
+        void _write(Level level, std::string_view line) override;
+    private:
+        void _rotate();
+
+        std::uintmax_t const _max_size;
+        std::chrono::seconds const _max_age;
+        std::size_t const _max_files;
+        std::chrono::steady_clock::time_point _opened_at;
+    };
+
+    /** Discards all lines, to benchmark formatting & dispatching alone.*/
+    class SSS_COMMONS_API NullSink : public Sink {
+    public:
+        using Sink::Sink;
+    protected:
+        void _write(Level, std::string_view) override {};
+    };
+
+    /** Hands lines to a user callback, called with the sink locked.
+     *  Lines logged from the callback are written once the line being
+     *  dispatched was, and lines those log in turn are dropped.
+     */
+    class SSS_COMMONS_API CallbackSink : public Sink {
+    public:
+        /** Callback type, receiving the level and the full line.*/
+        using Callback = std::function<void(Level, std::string_view)>;
+        /** Constructor, see Sink::Sink().*/
+        explicit CallbackSink(Callback callback, Level level = Level::msg,
+            Flush flush = Flush::batch);
+    protected:
+        void _write(Level level, std::string_view line) override;
+    private:
+        Callback const _callback;
+    };
+
+    /** Adds the given sink to the list of written sinks.
+     *  Adding the same sink twice has no effect.
+     */
+    SSS_COMMONS_API void addSink(std::shared_ptr<Sink> sink);
+    /** Removes the given sink from the list of written sinks, and flushes it.*/
+    SSS_COMMONS_API void removeSink(std::shared_ptr<Sink> const& sink);
+    /** Removes all sinks, the default ConsoleSink included.*/
+    SSS_COMMONS_API void clearSinks();
+    /** Returns the default ConsoleSink, registered at startup.*/
+    SSS_COMMONS_API std::shared_ptr<ConsoleSink> const& consoleSink() noexcept;
+
+    INTERNAL_BEGIN;
+
+    // Writes the given line to all sinks accepting its level. Lines
+    // dispatched from within a sink are deferred until it returns.
+    SSS_COMMONS_API void dispatch(Level level, std::string_view line, bool batch_end = true) noexcept;
+    // Returns true if the calling thread is within dispatch()
+    SSS_COMMONS_API bool isDispatching() noexcept;
+    // Signals the end of a batch of lines to all sinks
+    SSS_COMMONS_API void endBatch() noexcept;
+    // Flushes all sinks
+    SSS_COMMONS_API void flushSinks() noexcept;
+
+    INTERNAL_END;
+}
+
+#pragma warning(pop)
+
+SSS_END;
+
+#endif // SSS_COMMONS_LOGSINK_HPP
@@ -0,0 +1,239 @@
+#ifndef SSS_COMMONS_PARALLEL_HPP
+#define SSS_COMMONS_PARALLEL_HPP
+
+#include "_includes.hpp"
+#include "ThreadPool.hpp"
+
+/** @file
+ *  Defines SSS::parallel_for() and SSS::parallel_reduce() functions.
+ */
+
+SSS_BEGIN;
+
+INTERNAL_BEGIN;
+
+// Splits [0, count) in contiguous chunks, claimed in order by the calling
+// thread and by helper jobs of the pool. The calling thread always takes
+// part, so that nested loops progress even when all workers are busy.
+class ParallelLoop {
+public:
+    ParallelLoop(std::size_t count, std::size_t chunk) noexcept
+        : _count(count), _chunk(chunk), _chunks((count + chunk - 1) / chunk) {};
+
+    inline std::size_t chunks() const noexcept { return _chunks; };
+
+    // Runs body(chunk_index, begin, end) on chunks until none is left.
+    // body is only accessed while a chunk is claimed, so helper jobs
+    // starting after the loop returned don't touch it.
+    template <class Body>
+    void work(Body& body) noexcept
+    {
+        for (;;) {
+            std::size_t const index = _next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= _chunks) {
+                return;
+            }
+            try {
+                std::size_t const begin = index * _chunk;
+                body(index, begin, std::min(begin + _chunk, _count));
+            }
+            catch (...) {
+                {
+                    std::unique_lock const lock(_mutex);
+                    if (!_error) {
+                        _error = std::current_exception();
+                    }
+                }
+                // Skip chunks which weren't claimed yet
+                std::size_t const claimed = _next.exchange(_chunks, std::memory_order_relaxed);
+                _finished(_chunks - std::min(claimed, _chunks));
+            }
+            _finished(1);
+        }
+    };
+
+    // Waits for claimed chunks, then rethrows the first exception, if any
+    void wait(ThreadPool& pool)
+    {
+        while (_done.load(std::memory_order_acquire) != _chunks) {
+            if (pool.isWorker() && pool.runPending()) {
+                continue;
+            }
+            std::unique_lock lock(_mutex);
+            _cv.wait(lock, [this] { return _done.load(std::memory_order_acquire) == _chunks; });
+        }
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    };
+
+private:
+    void _finished(std::size_t count) noexcept
+    {
+        if (count != 0 && _done.fetch_add(count, std::memory_order_acq_rel) + count == _chunks) {
+            {
+                std::unique_lock const lock(_mutex);
+            }
+            _cv.notify_all();
+        }
+    };
+
+    std::size_t const _count;
+    std::size_t const _chunk;
+    std::size_t const _chunks;
+    alignas(cache_line_size) std::atomic<std::size_t> _next{ 0 };
+    alignas(cache_line_size) std::atomic<std::size_t> _done{ 0 };
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::exception_ptr _error;
+};
+
+// Returns the chunk size for the given count, aiming at a few chunks
+// per thread so that uneven chunks balance out
+inline std::size_t chunkSize(std::size_t count, std::size_t grain, ThreadPool const& pool) noexcept
+{
+    std::size_t const target = (pool.size() + 1) * 4;
+    return std::max({ grain, std::size_t(1), (count + target - 1) / target });
+}
+
+// Runs body on all chunks of [0, count), on the calling thread and the pool
+template <class Body>
+void parallelChunks(std::size_t count, std::size_t chunk, ThreadPool& pool, Body& body)
+{
+    auto loop = std::make_shared<ParallelLoop>(count, chunk);
+    std::size_t const helpers = std::min(loop->chunks() - 1, pool.size());
+    for (std::size_t i = 0; i < helpers; ++i) {
+        pool.submit([loop, &body]() { loop->work(body); });
+    }
+    loop->work(body);
+    loop->wait(pool);
+}
+
+INTERNAL_END;
+
+/** Calls the given function for each index of [first, last), in parallel.
+ *
+ *  The range is split in contiguous chunks run by the calling thread
+ *  and by the workers of the given pool (the pool of SSS::Async by
+ *  default). As the calling thread takes part, parallel loops may be
+ *  nested, or called from jobs of the pool, without deadlocking.\n
+ *  Returns once all indexes were processed. If the function throws,
+ *  remaining chunks are skipped and the first exception is rethrown.
+ *
+ *  @usage
+ *  @code
+ *  SSS::parallel_for(std::size_t(0), pixels.size(), [&](std::size_t i) {
+ *      pixels[i] = toGrayscale(pixels[i]);
+ *  });
+ *  @endcode
+ *  @param[in] first The first index.
+ *  @param[in] last The index past the last one.
+ *  @param[in] func The function to call, taking an index.
+ *  @param[in] grain The minimum number of indexes per chunk,
+ *  zero meaning automatic.
+ *  @param[in] pool The pool to run on.
+ *  @sa parallel_reduce()
+ */
+template <std::integral Index, class F>
+void parallel_for(Index first, Index last, F&& func, std::size_t grain = 0,
+    ThreadPool& pool = ThreadPool::shared())
+{
+    if (last <= first) {
+        return;
+    }
+    std::size_t const count = static_cast<std::size_t>(last - first);
+    auto body = [&](std::size_t, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            func(static_cast<Index>(first + static_cast<Index>(i)));
+        }
+    };
+    if (count == 1) {
+        body(0, 0, count);
+        return;
+    }
+    _internal::parallelChunks(count, _internal::chunkSize(count, grain, pool), pool, body);
+}
+
+/** Calls the given function for each element of the given
+ *  random access container (e.g. \c std::vector), in parallel.
+ *  See parallel_for(Index, Index, F&&, std::size_t, ThreadPool&).
+ *
+ *  @usage
+ *  @code
+ *  SSS::parallel_for(Shape::getInstances(), [](auto const& shape) {
+ *      shape->update();
+ *  });
+ *  @endcode
+ *  @param[in] container The container whose elements to process.
+ *  @param[in] func The function to call, taking an element.
+ *  @param[in] grain The minimum number of elements per chunk,
+ *  zero meaning automatic.
+ *  @param[in] pool The pool to run on.
+ */
+template <class Container, class F>
+    requires requires (Container& c) { std::size(c); std::begin(c)[0]; }
+void parallel_for(Container&& container, F&& func, std::size_t grain = 0,
+    ThreadPool& pool = ThreadPool::shared())
+{
+    auto const begin = std::begin(container);
+    parallel_for(std::size_t(0), static_cast<std::size_t>(std::size(container)),
+        [&](std::size_t i) { func(begin[i]); }, grain, pool);
+}
+
+/** Reduces the values mapped from each index of [first, last), in parallel.
+ *
+ *  Each chunk folds <tt>reduce(acc, map(i))</tt> over its indexes,
+ *  starting from \c identity, then chunk results are folded in index
+ *  order: the result doesn't depend on thread timings, even for
+ *  floating point values. Runs like parallel_for().
+ *
+ *  @usage
+ *  @code
+ *  float const luminance = SSS::parallel_reduce(std::size_t(0), pixels.size(), 0.f,
+ *      [&](std::size_t i) { return luma(pixels[i]); }, std::plus<>());
+ *  @endcode
+ *  @param[in] first The first index.
+ *  @param[in] last The index past the last one.
+ *  @param[in] identity The identity value of \c reduce.
+ *  @param[in] map The function taking an index, and returning a value.
+ *  @param[in] reduce The associative function combining two values.
+ *  @param[in] grain The minimum number of indexes per chunk,
+ *  zero meaning automatic.
+ *  @param[in] pool The pool to run on.
+ *  @return The reduced value, or \c identity if the range is empty.
+ */
+template <std::integral Index, class T, class Map, class Reduce>
+T parallel_reduce(Index first, Index last, T identity, Map&& map, Reduce&& reduce,
+    std::size_t grain = 0, ThreadPool& pool = ThreadPool::shared())
+{
+    if (last <= first) {
+        return identity;
+    }
+    std::size_t const count = static_cast<std::size_t>(last - first);
+    auto const fold = [&](T acc, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            acc = reduce(std::move(acc), map(static_cast<Index>(first + static_cast<Index>(i))));
+        }
+        return acc;
+    };
+    if (count == 1) {
+        return fold(std::move(identity), 0, count);
+    }
+
+    std::size_t const chunk = _internal::chunkSize(count, grain, pool);
+    std::vector<std::optional<T>> partials((count + chunk - 1) / chunk);
+    auto body = [&](std::size_t index, std::size_t begin, std::size_t end) {
+        partials[index].emplace(fold(identity, begin, end));
+    };
+    _internal::parallelChunks(count, chunk, pool, body);
+
+    T result = std::move(identity);
+    for (std::optional<T>& partial : partials) {
+        result = reduce(std::move(result), std::move(*partial));
+    }
+    return result;
+}
+
+SSS_END;
+
+#endif // SSS_COMMONS_PARALLEL_HPP
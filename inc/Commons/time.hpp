@@ -40,9 +40,31 @@ inline std::string convertTime(std::chrono::duration<_Rep, _Period> const& durat
 
 /** Returns current UTF time in a formatted string.
  *  @return Time formated as such : <tt>hh:mm:ss.ms UTF</tt>
+ *  @sa cachedTimeUTF()
  */
 SSS_COMMONS_API std::string timeUTF();
 
+/** Formats given time point the same way timeUTF() does, without allocating.
+ *  Each thread keeps the <tt>hh:mm:ss.</tt> prefix of its previous call,
+ *  which is only formatted again when the second changes.
+ *  @return A view over a thread-local buffer, valid until the next
+ *  call from the same thread.
+ */
+SSS_COMMONS_API std::string_view cachedTimeUTF(std::chrono::system_clock::time_point time) noexcept;
+
+/** Returns a raw monotonic timestamp, in nanoseconds.
+ *  Cheap to take, these stamps are meant to be formatted later on
+ *  via monotonicToSystem() and cachedTimeUTF().
+ */
+inline long long monotonicNS() noexcept
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+};
+
+/** Converts a monotonicNS() stamp to the system time it was taken at.*/
+SSS_COMMONS_API std::chrono::system_clock::time_point monotonicToSystem(long long ns) noexcept;
+
 // Ignore warning about STL exports as they're private members
 #pragma warning(push, 2)
 #pragma warning(disable: 4251)
@@ -102,7 +124,24 @@ public:
      * @sa addFrame()
      */
     inline long long longestFrame() const noexcept { return _last_longest_frame; };
-    
+
+    /** Returns the time (in ms) of the last frame.
+     *  @sa addFrame(), isOverBudget()
+     */
+    inline double lastFrame() const noexcept { return _last_frame; };
+    /** Sets the frame time budget (in ms), zero meaning none.
+     *  @sa isOverBudget()
+     */
+    inline void setBudget(double ms) noexcept { _budget = ms; };
+    /** Returns the frame time budget (in ms), see setBudget().*/
+    inline double getBudget() const noexcept { return _budget; };
+    /** Returns \c true if the last frame exceeded the budget.
+     *  Typically given to ThreadPool::setThrottled() each frame,
+     *  so that background work yields to the main thread.
+     *  @sa setBudget(), lastFrame()
+     */
+    inline bool isOverBudget() const noexcept { return _budget > 0.0 && _last_frame > _budget; };
+
 private:
     long long _frames{ 0 }; // Frames counter
     long long _fps{ 0 };    // FPS value
@@ -110,6 +149,9 @@ private:
     long long _current_longest_frame{ 0 };  // Longest frame from current second
     long long _last_longest_frame{ 0 };     // Longest frame from last second
 
+    double _last_frame{ 0.0 };  // Last frame time
+    double _budget{ 0.0 };      // Frame time budget, see setBudget()
+
     // Time the instance was created
     std::chrono::system_clock::time_point const _start_time
         { std::chrono::system_clock::now() };
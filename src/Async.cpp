@@ -1,118 +1,611 @@
 #include "Commons/Async.hpp"
+#include <map>
+#include <shared_mutex>
 
 SSS_BEGIN;
 
 void pollAsync()
 {
-    _internal::AsyncBase::_poll();
+    _internal::AsyncBase::_poll(std::chrono::nanoseconds::max());
 }
 
-INTERNAL_BEGIN;
+std::size_t pollAsync(std::chrono::nanoseconds budget)
+{
+    return _internal::AsyncBase::_poll(budget);
+}
 
-std::set<AsyncBase::Ref> AsyncBase::_pending;
-std::mutex AsyncBase::_mutex;
+// Metrics of each SSS::Async type, never removed so that
+// instances can keep a pointer to theirs
+static std::shared_mutex _metrics_mutex;
+static std::map<std::string_view, std::unique_ptr<_internal::AsyncTypeMetrics>> _metrics_map;
+static std::atomic<bool> _metrics_enabled{ true };
 
-std::strong_ordering operator<=>(AsyncBase::Ref const& a, AsyncBase::Ref const& b)
+std::vector<AsyncMetrics> asyncMetrics()
 {
-    return &a.get() <=> &b.get();
+    std::vector<AsyncMetrics> ret;
+    std::shared_lock const lock(_metrics_mutex);
+    ret.reserve(_metrics_map.size());
+    for (auto const& [type, metrics] : _metrics_map) {
+        AsyncMetrics& snapshot = ret.emplace_back();
+        snapshot.type = type;
+        snapshot.runs = metrics->runs.load(std::memory_order_relaxed);
+        snapshot.canceled = metrics->canceled.load(std::memory_order_relaxed);
+        snapshot.exceptions = metrics->exceptions.load(std::memory_order_relaxed);
+        snapshot.queue_latency = metrics->queue_latency.snapshot();
+        snapshot.run_time = metrics->run_time.snapshot();
+        snapshot.pending_time = metrics->pending_time.snapshot();
+        snapshot.cancel_wait = metrics->cancel_wait.snapshot();
+    }
+    return ret;
 }
 
-AsyncBase::AsyncBase()
+void resetAsyncMetrics() noexcept
 {
-    if (Log::Async::query(Log::Async::get().life_state)) {
-        LOG_CONSTRUCTOR;
+    std::shared_lock const lock(_metrics_mutex);
+    for (auto const& [type, metrics] : _metrics_map) {
+        metrics->queue_latency.reset();
+        metrics->run_time.reset();
+        metrics->pending_time.reset();
+        metrics->cancel_wait.reset();
+        metrics->runs.store(0, std::memory_order_relaxed);
+        metrics->canceled.store(0, std::memory_order_relaxed);
+        metrics->exceptions.store(0, std::memory_order_relaxed);
     }
 }
 
+void enableAsyncMetrics(bool enabled) noexcept
+{
+    _metrics_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool asyncMetricsEnabled() noexcept
+{
+    return _metrics_enabled.load(std::memory_order_relaxed);
+}
+
+INTERNAL_BEGIN;
+
+std::atomic<AsyncBase*> AsyncBase::_completed{ nullptr };
+AsyncBase* AsyncBase::_carry_head = nullptr;
+AsyncBase* AsyncBase::_carry_tail = nullptr;
+std::mutex AsyncBase::_poll_mutex;
+std::vector<AsyncBase*> AsyncBase::_armed;
+std::mutex AsyncBase::_armed_mutex;
+std::atomic<ThreadPool*> AsyncBase::_default_executor{ nullptr };
+std::atomic<bool> AsyncBase::_default_std_async{ false };
+
+AsyncBase::AsyncBase()
+{
+    LOG_IF_MSG(Log::Async, life_state) LOG_CONSTRUCTOR;
+}
+
 AsyncBase::~AsyncBase()
 {
     cancel();
 
-    {
-        std::unique_lock const lock(_mutex);
-        _pending.erase(*this);
+    // No run can enqueue this instance anymore, unlink it if queued
+    if (_in_queue) {
+        std::unique_lock const lock(_poll_mutex);
+        _collect();
+        AsyncBase* prev = nullptr;
+        for (AsyncBase* node = _carry_head; node != nullptr; prev = node, node = node->_next) {
+            if (node != this) {
+                continue;
+            }
+            (prev != nullptr ? prev->_next : _carry_head) = _next;
+            if (_carry_tail == this) {
+                _carry_tail = prev;
+            }
+            break;
+        }
     }
 
-    if (Log::Async::query(Log::Async::get().life_state)) {
-        LOG_DESTRUCTOR;
-    }
+    LOG_IF_MSG(Log::Async, life_state) LOG_DESTRUCTOR;
 }
 
 void AsyncBase::cancel() noexcept try
 {
+    _dropTrailing();
+
     // Return if async function was already canceled.
-    if (!_future.valid()) {
+    if (!_future.valid() && _detached.empty()) {
         return;
     }
 
     // Log cancelation start
-    bool const was_running = _running_state == _RunningState::running;
-    if (Log::Async::query(Log::Async::get().run_state) && was_running) {
-        LOG_OBJ_MSG("Canceling function ...");
+    bool const dropped = _unhandled();
+    bool const was_running = isRunning();
+    if (was_running) {
+        LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Canceling function ...");
     }
 
-    // Cancel async function
+    // Cancel async function, and drop its result if already pending
+    auto const start = std::chrono::steady_clock::now();
     _is_canceled = true;
-    _future.wait();
+    _nextGeneration(_stateOf(_run_state));
+    _dropQueued();
+    auto const is_done = [](std::future<void> const& future) {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    // Only record waits which blocked, as each restart calls cancel()
+    bool const blocks = (_future.valid() && !is_done(_future))
+        || !std::all_of(_detached.cbegin(), _detached.cend(), is_done);
+    if (_future.valid()) {
+        _future.wait();
+    }
+    for (std::future<void> const& future : _detached) {
+        future.wait();
+    }
+    if (AsyncTypeMetrics* const metrics = _getMetrics(); metrics != nullptr && blocks) {
+        metrics->cancel_wait.record(_elapsed(start));
+    }
+    _detached.clear();
     _is_canceled = false;
-    _running_state = _RunningState::handled;
+    _setState(_RunningState::handled);
 
     // Log cancelation end
-    if (Log::Async::query(Log::Async::get().run_state) && was_running) {
-        LOG_OBJ_MSG("Function was successfully canceled.");
+    if (was_running) {
+        LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Function was successfully canceled.");
+    }
+    if (dropped) {
+        _dropped(nullptr);
     }
 }
 CATCH_ASYNCBASE_ERROR;
 
+void AsyncBase::requestCancel() noexcept try
+{
+    _dropTrailing();
+
+    if (!_future.valid()) {
+        return;
+    }
+    bool const dropped = _unhandled();
+    _nextGeneration(_RunningState::handled);
+    if (!_dropQueued()) {
+        _detached.emplace_back(std::move(_future));
+    }
+    LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Function was flagged as canceled.");
+    if (dropped) {
+        _dropped(nullptr);
+    }
+}
+CATCH_ASYNCBASE_ERROR;
+
+std::uint64_t AsyncBase::_restart()
+{
+    if (_restart_mode != Restart::detach) {
+        cancel();
+    }
+    else if (_future.valid()) {
+        if (isRunning()) {
+            LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Detaching superseded function ...");
+        }
+        bool const dropped = _unhandled();
+        if (!_dropQueued()) {
+            _detached.emplace_back(std::move(_future));
+        }
+        if (dropped) {
+            _dropped(nullptr);
+        }
+    }
+    // Forget superseded runs which already returned
+    std::erase_if(_detached, [](std::future<void> const& future) {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+
+    return _nextGeneration(_RunningState::running);
+}
+
+bool AsyncBase::_dropQueued() noexcept try
+{
+    if (!_claimed || _claimed->exchange(true)) {
+        return false;
+    }
+    // The worker will return right away, without accessing this instance
+    _claimed.reset();
+    _future = std::future<void>();
+    if (_completion) {
+        _completion->setValue();
+    }
+    LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Queued function was dropped.");
+    return true;
+}
+catch (...) {
+    return true;
+}
+
+bool AsyncBase::_unhandled() const noexcept
+{
+    // Observers restarting the run being handled don't drop it
+    return !_handling && _stateOf(_run_state) != _RunningState::handled;
+}
+
+bool AsyncBase::_coalescing() const noexcept
+{
+    if (_restart_mode != Restart::coalesce) {
+        return false;
+    }
+    {
+        std::unique_lock const lock(_armed_mutex);
+        if (_trailing) {
+            return true;
+        }
+    }
+    return _stateOf(_run_state) != _RunningState::handled
+        || std::chrono::steady_clock::now() - _last_start < _coalesce_window;
+}
+
+void AsyncBase::_defer(Job trailing) noexcept try
+{
+    bool coalesced;
+    {
+        std::unique_lock const lock(_armed_mutex);
+        coalesced = static_cast<bool>(_trailing);
+        if (coalesced) {
+            _coalesced_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            _armed.push_back(this);
+        }
+        _trailing = std::move(trailing);
+    }
+    // The replaced run will never start
+    if (coalesced) {
+        _dropped(nullptr);
+    }
+}
+CATCH_ASYNCBASE_ERROR;
+
+void AsyncBase::_dropTrailing() noexcept
+{
+    {
+        std::unique_lock const lock(_armed_mutex);
+        if (!_trailing) {
+            return;
+        }
+        _trailing = Job();
+        std::erase(_armed, this);
+    }
+    _dropped(nullptr);
+}
+
+void AsyncBase::_startTrailing() noexcept try
+{
+    std::vector<Job> due;
+    {
+        std::unique_lock const lock(_armed_mutex);
+        if (_armed.empty()) {
+            return;
+        }
+        auto const now = std::chrono::steady_clock::now();
+        std::erase_if(_armed, [&](AsyncBase* async) {
+            // Let the previous run be handled, keeping its result
+            if (_stateOf(async->_run_state) != _RunningState::handled
+                || now - async->_last_start < async->_coalesce_window)
+            {
+                return false;
+            }
+            due.emplace_back(std::move(async->_trailing));
+            async->_trailing = Job();
+            return true;
+        });
+    }
+    for (Job& job : due) {
+        job();
+    }
+}
+catch (...) {
+}
+
 bool AsyncBase::isRunning() const noexcept
 {
-    return _running_state == _RunningState::running;
+    return _stateOf(_run_state) == _RunningState::running;
+}
+
+void AsyncBase::setExecutor(ThreadPool* pool) noexcept
+{
+    _executor = pool;
+    _has_executor = true;
+}
+
+void AsyncBase::resetExecutor() noexcept
+{
+    _executor = nullptr;
+    _has_executor = false;
+}
+
+void AsyncBase::setDefaultExecutor(ThreadPool* pool) noexcept
+{
+    _default_executor = pool;
+    _default_std_async = pool == nullptr;
+}
+
+ThreadPool* AsyncBase::getDefaultExecutor() noexcept
+{
+    if (_default_std_async) {
+        return nullptr;
+    }
+    ThreadPool* const pool = _default_executor;
+    return pool != nullptr ? pool : &ThreadPool::shared();
+}
+
+Task<> AsyncBase::completion() const noexcept
+{
+    return Task<>(_completion);
+}
+
+void AsyncBase::_newCompletion(ThreadPool* pool)
+{
+    // Never leave the previous run's task, should this throw
+    _completion.reset();
+    _completion = std::make_shared<TaskState<void>>(pool != nullptr ? *pool : ThreadPool::shared());
+}
+
+void AsyncBase::_launchFailed(std::exception const& e) noexcept
+{
+    if (_completion && !_completion->isReady()) {
+        try {
+            _completion->setError(std::current_exception());
+        }
+        catch (...) {
+        }
+    }
+    _claimed.reset();
+    _future = std::future<void>();
+    _setState(_RunningState::handled);
+    // A broken executor fails every run
+    LOG_EVERY_MS(1000) LOG_CTX_ERR(CONTEXT_MSG(THIS_NAME, "Exception was caught"), e.what());
+    _dropped(std::current_exception());
+}
+
+ThreadPool* AsyncBase::_getExecutor() const noexcept
+{
+    return _has_executor ? _executor : getDefaultExecutor();
+}
+
+ThreadPool::Clock::time_point AsyncBase::_runDeadline() const noexcept
+{
+    if (_deadline <= std::chrono::nanoseconds(0)) {
+        return ThreadPool::Clock::time_point::max();
+    }
+    return ThreadPool::Clock::now()
+        + std::chrono::duration_cast<ThreadPool::Clock::duration>(_deadline);
+}
+
+AsyncTypeMetrics* AsyncBase::_getMetrics() noexcept try
+{
+    if (!asyncMetricsEnabled()) {
+        return nullptr;
+    }
+    if (AsyncTypeMetrics* const metrics = _metrics.load(std::memory_order_relaxed)) {
+        return metrics;
+    }
+    std::string_view const type = THIS_NAME;
+    AsyncTypeMetrics* metrics = nullptr;
+    {
+        std::shared_lock const lock(_metrics_mutex);
+        if (auto const it = _metrics_map.find(type); it != _metrics_map.cend()) {
+            metrics = it->second.get();
+        }
+    }
+    if (metrics == nullptr) {
+        std::unique_lock const lock(_metrics_mutex);
+        std::unique_ptr<AsyncTypeMetrics>& entry = _metrics_map[type];
+        if (!entry) {
+            entry = std::make_unique<AsyncTypeMetrics>();
+        }
+        metrics = entry.get();
+    }
+    _metrics.store(metrics, std::memory_order_relaxed);
+    return metrics;
+}
+catch (...) {
+    return nullptr;
+}
+
+std::uint64_t AsyncBase::_elapsed(std::chrono::steady_clock::time_point since) noexcept
+{
+    auto const elapsed = std::chrono::steady_clock::now() - since;
+    return static_cast<std::uint64_t>(std::max<long long>(0,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+}
+
+// Run being executed by the calling thread
+static thread_local AsyncBase const* _current_self = nullptr;
+static thread_local std::uint64_t _current_generation = 0;
+
+AsyncBase::_CurrentRun AsyncBase::_swapCurrentRun(_CurrentRun run) noexcept
+{
+    _CurrentRun const previous{ _current_self, _current_generation };
+    _current_self = run.self;
+    _current_generation = run.generation;
+    return previous;
 }
 
 bool AsyncBase::_beingCanceled() const noexcept
 {
-    return _is_canceled;
+    if (_is_canceled) {
+        return true;
+    }
+    // A superseded run is canceled
+    return _current_self == this && _current_generation != _generationOf(_run_state);
+}
+
+void AsyncBase::_setState(_RunningState state) noexcept
+{
+    std::uint64_t word = _run_state.load();
+    while (!_run_state.compare_exchange_weak(word, _word(_generationOf(word), state)));
+}
+
+std::uint64_t AsyncBase::_nextGeneration(_RunningState state) noexcept
+{
+    std::uint64_t word = _run_state.load();
+    while (!_run_state.compare_exchange_weak(word, _word(_generationOf(word) + 1, state)));
+    return _generationOf(word) + 1;
+}
+
+// Coroutines awaiting SSS::nextPoll(), and those being resumed by the
+// current poll in reverse order, popped one at a time as resuming one
+// coroutine may destroy others
+static std::mutex _resumes_mutex;
+static std::vector<std::coroutine_handle<>> _resumes;
+static std::vector<std::coroutine_handle<>> _resuming;
+
+void resumeOnPoll(std::coroutine_handle<> handle)
+{
+    std::unique_lock const lock(_resumes_mutex);
+    _resumes.push_back(handle);
 }
 
-void AsyncBase::_poll() noexcept
+void cancelResumeOnPoll(std::coroutine_handle<> handle) noexcept
 {
-    std::set<Ref> to_handle;
+    std::unique_lock const lock(_resumes_mutex);
+    std::erase(_resumes, handle);
+    std::erase(_resuming, handle);
+}
+
+std::size_t AsyncBase::_poll(std::chrono::nanoseconds budget) noexcept try
+{
+    auto const start = std::chrono::steady_clock::now();
+    // Coroutines suspended meanwhile wait for the next poll
     {
-        std::unique_lock const lock(_mutex);
-        std::swap(to_handle, _pending);
+        std::unique_lock const lock(_resumes_mutex);
+        _resuming.insert(_resuming.begin(), _resumes.crbegin(), _resumes.crend());
+        _resumes.clear();
+    }
+    for (;;) {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock const lock(_resumes_mutex);
+            if (_resuming.empty()) {
+                break;
+            }
+            handle = _resuming.back();
+            _resuming.pop_back();
+        }
+        handle.resume();
+    }
+
+    std::unique_lock lock(_poll_mutex);
+    _collect();
+    // Only handle instances completed before this call
+    AsyncBase* const last = _carry_tail;
+    bool first = true;
+    while (_carry_head != nullptr) {
+        if (!first && std::chrono::steady_clock::now() - start >= budget) {
+            break;
+        }
+        first = false;
+
+        AsyncBase* const node = _carry_head;
+        _carry_head = node->_next;
+        if (_carry_head == nullptr) {
+            _carry_tail = nullptr;
+        }
+        node->_next = nullptr;
+        node->_in_queue.store(false);
+        // Observers may destroy instances, or poll again
+        lock.unlock();
+        node->_handle();
+        lock.lock();
+        if (node == last) {
+            break;
+        }
+    }
+    std::size_t left = 0;
+    for (AsyncBase* node = _carry_head; node != nullptr; node = node->_next) {
+        ++left;
     }
-    for (auto&& ref : to_handle)
-        ref.get()._handle();
+    lock.unlock();
+    _startTrailing();
+    return left;
+}
+catch (...) {
+    return 0;
 }
 
-void AsyncBase::_postRun() noexcept
+void AsyncBase::_collect() noexcept
 {
-    if (Log::Async::query(Log::Async::get().run_state) && !_is_canceled) {
-        LOG_OBJ_MSG("Function ended, now pending.");
+    // Reverse the stack to append instances in completion order
+    AsyncBase* node = _completed.exchange(nullptr, std::memory_order_acquire);
+    AsyncBase* reversed = nullptr;
+    AsyncBase* const tail = node;
+    while (node != nullptr) {
+        AsyncBase* const next = node->_next;
+        node->_next = reversed;
+        reversed = node;
+        node = next;
     }
-    _running_state = _RunningState::pending;
+    if (reversed == nullptr) {
+        return;
+    }
+    (_carry_tail != nullptr ? _carry_tail->_next : _carry_head) = reversed;
+    _carry_tail = tail;
+}
+
+void AsyncBase::_postRun(std::uint64_t generation) noexcept try
+{
+    if (!_beingCanceled()) {
+        LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Function ended, now pending.");
+    }
+
+    // Drop results of superseded or canceled runs
+    std::uint64_t expected = _word(generation, _RunningState::running);
+    _pending_since.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+        std::memory_order_relaxed);
+    if (!_run_state.compare_exchange_strong(expected, _word(generation, _RunningState::pending))) {
+        return;
+    }
+    // Push on the completion stack, unless already queued
+    if (_in_queue.exchange(true)) {
+        return;
+    }
+    _next = _completed.load(std::memory_order_relaxed);
+    while (!_completed.compare_exchange_weak(_next, this,
+        std::memory_order_release, std::memory_order_relaxed));
+}
+catch (...) {
+}
 
-    std::unique_lock const lock(_mutex);
-    _pending.emplace(*this);
+void AsyncBase::_caught(std::uint64_t generation, std::exception const& e) noexcept
+{
+    std::uint64_t expected = _word(generation, _RunningState::running);
+    _run_state.compare_exchange_strong(expected, _word(generation, _RunningState::handled));
+    LOG_CTX_ERR(CONTEXT_MSG(THIS_NAME, "Exception was caught"), e.what());
 }
 
 void AsyncBase::_handle() noexcept
 {
-    if (_running_state != _RunningState::pending) {
-        LOG_OBJ_WRN("Tried to set function state as 'handled' when it wasn't 'pending'");
+    // The instance may have been restarted or canceled since queued
+    std::uint64_t const word = _run_state;
+    if (_stateOf(word) != _RunningState::pending) {
         return;
     }
+    if (AsyncTypeMetrics* const metrics = _getMetrics(); metrics != nullptr) {
+        metrics->pending_time.record(_elapsed(std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(_pending_since.load(std::memory_order_relaxed)))));
+    }
 
-    _notifyObservers();
-    
-    _running_state = _RunningState::handled;
+    // Let the worker return, and take the result before observers
+    // may start a new run, replacing both _future and the result
     if (_future.valid()) {
         _future.wait();
     }
+    _claimResult();
 
-    if (Log::Async::query(Log::Async::get().run_state)) {
-        LOG_OBJ_MSG("Function has been handled.");
-    }
+    _handling = true;
+    _notifyObservers();
+    _handling = false;
+
+    // Keep a run started by observers running
+    std::uint64_t expected = word;
+    _run_state.compare_exchange_strong(expected, _word(_generationOf(word), _RunningState::handled));
+
+    LOG_IF_MSG(Log::Async, run_state) LOG_OBJ_MSG("Function has been handled.");
+
+    // Last access, the instance may be destroyed from there
+    _handled();
 }
 
 INTERNAL_END;
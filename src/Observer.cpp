@@ -1,57 +1,546 @@
 #include "Commons/Observer.hpp"
+#include "Commons/log.hpp"
 
 SSS_BEGIN;
 
+// Shared by a slot, the snapshots holding it and the observer's link,
+// so that notifiers skip detached observers, and detach waits for calls
+// in progress
+struct Subject::_LinkState {
+    // Keeps the subject's mutex alive, to detach after its destruction
+    std::shared_ptr<_Concurrent> core;
+    // Index of the slot, guarded by the subject's mutex
+    std::size_t slot{ 0 };
+    std::atomic<bool> attached{ true };
+    std::atomic<int> calls{ 0 };
+    // Set before waiting for calls, so that notifiers only wake detach then
+    std::atomic<bool> waiting{ false };
+};
+
+// Immutable copy of the live slots, walked by notifiers
+struct Subject::_Snapshot {
+    std::vector<_Slot> slots;
+    std::uint64_t mask{ 0 };
+};
+
+struct Subject::_Concurrent {
+    std::mutex mutex;
+    // Null once the subject is destroyed
+    Subject* subject{ nullptr };
+    std::shared_ptr<_Snapshot const> snapshot;
+};
+
+// Link states the calling thread is notifying, as a detach from within
+// a notification can't wait for the call it is part of
+static thread_local std::vector<void const*> _calling;
+
+Subject::Subject() = default;
+
 Subject::~Subject()
 {
-    for (auto const& observer : _observers) {
-        observer.get()._subjects.remove_if([this](auto&& ref) {
-            return &ref.get() == this;
-        });
+    if (_queued_events.load() != 0) {
+        EventBus::get()._purge(*this);
+    }
+    if (_concurrent) {
+        // Links are left to their observers, which drop them once detached
+        std::unique_lock const lock(_concurrent->mutex);
+        _concurrent->subject = nullptr;
+        // Breaks the cycle through the states of links
+        _concurrent->snapshot.reset();
+        for (_Slot const& slot : _slots) {
+            if (slot.state) {
+                slot.state->attached = false;
+            }
+        }
+        return;
+    }
+    for (_Slot const& slot : _slots) {
+        if (slot.observer != nullptr) {
+            slot.observer->_removeLink(slot.link);
+        }
     }
 }
 
-void Subject::_attachObserver(Observer& observer)
+void Subject::_makeConcurrent()
 {
-    _observers.emplace_back(observer);
+    if (_concurrent) {
+        return;
+    }
+    // Links of attached observers would need their state
+    if (_slots.size() != _dead) {
+        throw_exc("Subject::_makeConcurrent(): observers are already attached.");
+    }
+    _slots.clear();
+    _dead = 0;
+    _concurrent = std::make_shared<_Concurrent>();
+    _concurrent->subject = this;
 }
 
-void Subject::_detachObserver(Observer const& observer)
+void Subject::_attach(Observer& observer, std::shared_ptr<std::vector<int> const> event_ids,
+    std::uint64_t mask)
 {
-    _observers.remove_if([&observer](auto&& ref) {
-        return &ref.get() == &observer;
-    });
+    // Amortized, as links only reallocate when full
+    if (observer._links.size() == observer._links.capacity()) {
+        observer._dropDeadLinks();
+    }
+    std::unique_lock<std::mutex> lock;
+    std::shared_ptr<_LinkState> state;
+    if (_concurrent) {
+        lock = std::unique_lock(_concurrent->mutex);
+        state = std::make_shared<_LinkState>();
+        state->core = _concurrent;
+    }
+    _compact();
+    if (state) {
+        state->slot = _slots.size();
+    }
+    observer._links.push_back({ this, _slots.size(), state });
+    _slots.push_back({ &observer, observer._links.size() - 1, mask, std::move(event_ids),
+        std::move(state) });
+    _mask |= mask;
+    _publish();
 }
 
-void Subject::_notifyObservers(int event_id, int charges) const
+void Subject::_detachSlot(std::size_t slot) noexcept
 {
+    _Slot& detached = _slots[slot];
+    detached.observer = nullptr;
+    detached.event_ids.reset();
+    if (detached.state) {
+        detached.state->attached = false;
+        detached.state.reset();
+    }
+    ++_dead;
+    _compact();
+    try {
+        _publish();
+    }
+    catch (...) {
+        // Notifiers skip the observer anyway
+    }
+}
+
+void Subject::_detachConcurrent(_LinkState& state) noexcept
+{
+    // Holding the mutex keeps the subject from being destroyed meanwhile
+    std::unique_lock const lock(state.core->mutex);
+    if (state.core->subject != nullptr && state.attached.load()) {
+        state.core->subject->_detachSlot(state.slot);
+    }
+    state.attached = false;
+}
+
+void Subject::_waitCalls(_LinkState& state) noexcept
+{
+    // Pairs with _endCall(): either the notifier sees the observer
+    // detached, or it sees waiting set and wakes this thread once done
+    int const own = static_cast<int>(std::count(_calling.cbegin(), _calling.cend(), &state));
+    state.waiting = true;
+    for (int calls = state.calls.load(); calls > own; calls = state.calls.load()) {
+        state.calls.wait(calls);
+    }
+}
+
+static void _endCall(std::atomic<int>& calls, std::atomic<bool> const& waiting) noexcept
+{
+    calls.fetch_sub(1);
+    if (waiting.load()) {
+        calls.notify_all();
+    }
+}
+
+void Subject::_compact() noexcept
+{
+    // Amortized: only once at least half of the slots are dead.
+    // Concurrent notifiers walk snapshots, not slots.
+    if ((_notifying != 0 && !_concurrent) || _dead * 2 < _slots.size()) {
+        return;
+    }
+    // Stable, so that observers keep being notified in attach order
+    std::size_t size = 0;
+    _mask = 0;
+    for (_Slot& slot : _slots) {
+        if (slot.observer == nullptr) {
+            continue;
+        }
+        if (slot.state) {
+            slot.state->slot = size;
+        }
+        else {
+            slot.observer->_links[slot.link].slot = size;
+        }
+        _mask |= slot.mask;
+        _slots[size++] = std::move(slot);
+    }
+    _slots.resize(size);
+    _dead = 0;
+}
+
+void Subject::_publish()
+{
+    if (!_concurrent) {
+        return;
+    }
+    auto snapshot = std::make_shared<_Snapshot>();
+    snapshot->slots.reserve(_slots.size() - _dead);
+    for (_Slot const& slot : _slots) {
+        if (slot.observer == nullptr) {
+            continue;
+        }
+        snapshot->slots.push_back(slot);
+        snapshot->mask |= slot.mask;
+    }
+    _concurrent->snapshot = std::move(snapshot);
+}
+
+void Subject::_notifyConcurrent(int event_id, int charges) const
+{
+    std::shared_ptr<_Snapshot const> snapshot;
+    {
+        std::unique_lock const lock(_concurrent->mutex);
+        snapshot = _concurrent->snapshot;
+    }
+    std::uint64_t const bit = _bit(event_id);
+    if (!snapshot || (snapshot->mask & bit) == 0) {
+        return;
+    }
     Event event{ event_id, charges };
-    for (auto const& ref : _observers) {
-        ref.get()._subjectUpdate(*this, event);
+    for (_Slot const& slot : snapshot->slots) {
+        if ((slot.mask & bit) == 0) {
+            continue;
+        }
+        if (slot.event_ids
+            && !std::binary_search(slot.event_ids->cbegin(), slot.event_ids->cend(), event_id))
+        {
+            continue;
+        }
+        _LinkState& state = *slot.state;
+        state.calls.fetch_add(1);
+        if (!state.attached.load()) {
+            _endCall(state.calls, state.waiting);
+            continue;
+        }
+        _calling.push_back(&state);
+        try {
+            slot.observer->_subjectUpdate(*this, event);
+        }
+        catch (...) {
+            _calling.pop_back();
+            _endCall(state.calls, state.waiting);
+            throw;
+        }
+        _calling.pop_back();
+        _endCall(state.calls, state.waiting);
         if (event.charges == 0)
             break;
     }
 }
 
+void Subject::_notifyObservers(int event_id, int charges) const
+{
+    if (_concurrent) {
+        _notifyConcurrent(event_id, charges);
+        return;
+    }
+    std::uint64_t const bit = _bit(event_id);
+    if ((_mask & bit) == 0) {
+        return;
+    }
+    Event event{ event_id, charges };
+    ++_notifying;
+    try {
+        // Observers attached meanwhile are notified too
+        for (std::size_t i = 0; i < _slots.size(); ++i) {
+            _Slot const& slot = _slots[i];
+            if (slot.observer == nullptr || (slot.mask & bit) == 0) {
+                continue;
+            }
+            if (slot.event_ids
+                && !std::binary_search(slot.event_ids->cbegin(), slot.event_ids->cend(), event_id))
+            {
+                continue;
+            }
+            slot.observer->_subjectUpdate(*this, event);
+            if (event.charges == 0)
+                break;
+        }
+    }
+    catch (...) {
+        --_notifying;
+        throw;
+    }
+    --_notifying;
+}
+
+void Subject::_queueEvent(int event_id, int charges) const
+{
+    EventBus::get()._push(*this, event_id, charges);
+}
+
+void Subject::_emitEvent(int event_id, int charges) const
+{
+    if (EventBus::get().isDeferred()) {
+        _queueEvent(event_id, charges);
+    }
+    else {
+        _notifyObservers(event_id, charges);
+    }
+}
+
 Observer::~Observer()
 {
-    for (auto const& subject : _subjects) {
-        subject.get()._detachObserver(*this);
+    _ignoreAll();
+}
+
+void Observer::_ignoreAll() noexcept
+{
+    while (!_links.empty()) {
+        _Link const link = std::move(_links.back());
+        _links.pop_back();
+        if (link.state) {
+            Subject::_detachConcurrent(*link.state);
+            Subject::_waitCalls(*link.state);
+        }
+        else {
+            link.subject->_detachSlot(link.slot);
+        }
+    }
+}
+
+void Observer::_removeLink(std::size_t link) noexcept
+{
+    // Swap with the last link, whose slot then points to its new index
+    if (link != _links.size() - 1) {
+        _links[link] = std::move(_links.back());
+        _Link const& moved = _links[link];
+        if (!moved.state) {
+            moved.subject->_slots[moved.slot].link = link;
+        }
+    }
+    _links.pop_back();
+}
+
+void Observer::_dropDeadLinks() noexcept
+{
+    for (std::size_t i = _links.size(); i-- != 0;) {
+        if (_links[i].state && !_links[i].state->attached.load()) {
+            _removeLink(i);
+        }
     }
 }
 
 void Observer::_ignore(Subject& subject)
 {
-    _subjects.remove_if([&subject](auto&& ref) {
-        return &ref.get() == &subject;
-    });
-    subject._detachObserver(*this);
+    for (std::size_t i = _links.size(); i-- != 0;) {
+        if (_links[i].subject != &subject) {
+            continue;
+        }
+        _Link const link = std::move(_links[i]);
+        _removeLink(i);
+        if (link.state) {
+            Subject::_detachConcurrent(*link.state);
+            Subject::_waitCalls(*link.state);
+        }
+        else {
+            subject._detachSlot(link.slot);
+        }
+    }
 }
 
 void Observer::_observe(Subject& subject)
 {
-    _subjects.emplace_back(subject);
-    subject._attachObserver(*this);
+    subject._attach(*this, nullptr, ~std::uint64_t(0));
+}
+
+void Observer::_observe(Subject& subject, std::vector<int> event_ids)
+{
+    std::sort(event_ids.begin(), event_ids.end());
+    event_ids.erase(std::unique(event_ids.begin(), event_ids.end()), event_ids.end());
+    if (event_ids.empty()) {
+        _observe(subject);
+        return;
+    }
+    std::uint64_t mask = 0;
+    for (int const id : event_ids) {
+        mask |= Subject::_bit(id);
+    }
+    subject._attach(*this, std::make_shared<std::vector<int> const>(std::move(event_ids)), mask);
+}
+
+EventBus& EventBus::get()
+{
+    static EventBus instance;
+    return instance;
+}
+
+void EventBus::flush()
+{
+    {
+        std::unique_lock const lock(_mutex);
+        if (_flushing) {
+            return;
+        }
+        _flushing = true;
+        _draining.swap(_queue);
+        // Empties the coalescing table
+        if (++_generation == 0) {
+            std::fill(_buckets.begin(), _buckets.end(), _Bucket{ 0, 0 });
+            _generation = 1;
+        }
+    }
+
+    std::size_t i = 0;
+    try {
+        for (;; ++i) {
+            _Entry entry;
+            {
+                std::unique_lock const lock(_mutex);
+                if (i >= _draining.size()) {
+                    break;
+                }
+                entry = _draining[i];
+                if (entry.subject == nullptr) {
+                    continue;
+                }
+                --entry.subject->_queued_events;
+            }
+            // Observers may destroy subjects, purging their events
+            entry.subject->_notifyObservers(entry.id, entry.charges);
+        }
+    }
+    catch (...) {
+        // Drop the rest of the batch
+        std::unique_lock const lock(_mutex);
+        for (++i; i < _draining.size(); ++i) {
+            if (_draining[i].subject != nullptr) {
+                --_draining[i].subject->_queued_events;
+            }
+        }
+        _draining.clear();
+        _flushing = false;
+        throw;
+    }
+
+    std::unique_lock const lock(_mutex);
+    _draining.clear();
+    _flushing = false;
+}
+
+void EventBus::setDeferred(bool deferred) noexcept
+{
+    _deferred = deferred;
+}
+
+bool EventBus::isDeferred() const noexcept
+{
+    return _deferred;
+}
+
+void EventBus::setCoalescing(bool coalescing) noexcept
+{
+    std::unique_lock const lock(_mutex);
+    // Already queued events aren't indexed
+    if (coalescing && !_coalescing) {
+        _rehash();
+    }
+    _coalescing = coalescing;
+}
+
+bool EventBus::isCoalescing() const noexcept
+{
+    return _coalescing;
+}
+
+std::size_t EventBus::pendingCount() const
+{
+    std::unique_lock const lock(_mutex);
+    return _queue.size();
+}
+
+std::uint64_t EventBus::coalescedCount() const noexcept
+{
+    return _coalesced.load(std::memory_order_relaxed);
+}
+
+void EventBus::_push(Subject const& subject, int event_id, int charges)
+{
+    _Entry const entry{ &subject, event_id, charges };
+    std::unique_lock const lock(_mutex);
+    if (_coalescing && _coalesce(entry)) {
+        _coalesced.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    _queue.push_back(entry);
+    ++subject._queued_events;
+}
+
+void EventBus::_purge(Subject const& subject) noexcept
+{
+    std::unique_lock const lock(_mutex);
+    for (std::vector<_Entry>* entries : { &_queue, &_draining }) {
+        for (_Entry& entry : *entries) {
+            if (entry.subject == &subject) {
+                entry.subject = nullptr;
+            }
+        }
+    }
+    subject._queued_events = 0;
+}
+
+bool EventBus::_coalesce(_Entry const& entry)
+{
+    // Keep the load factor under 1/2
+    if ((_queue.size() + 1) * 2 > _buckets.size()) {
+        _buckets.assign(std::max<std::size_t>(64, _buckets.size() * 2), _Bucket{ 0, 0 });
+        _rehash();
+    }
+    std::size_t const mask = _buckets.size() - 1;
+    for (std::size_t i = _hash(entry) & mask;; i = (i + 1) & mask) {
+        _Bucket& bucket = _buckets[i];
+        if (bucket.generation != _generation) {
+            // Indexes the entry about to be pushed
+            bucket = { _generation, static_cast<std::uint32_t>(_queue.size()) };
+            return false;
+        }
+        _Entry const& queued = _queue[bucket.index];
+        if (queued.subject == entry.subject && queued.id == entry.id
+            && queued.charges == entry.charges)
+        {
+            return true;
+        }
+    }
+}
+
+void EventBus::_rehash()
+{
+    if (++_generation == 0) {
+        std::fill(_buckets.begin(), _buckets.end(), _Bucket{ 0, 0 });
+        _generation = 1;
+    }
+    if (_buckets.empty()) {
+        return;
+    }
+    std::size_t const mask = _buckets.size() - 1;
+    for (std::size_t index = 0; index < _queue.size(); ++index) {
+        _Entry const& entry = _queue[index];
+        if (entry.subject == nullptr) {
+            continue;
+        }
+        std::size_t i = _hash(entry) & mask;
+        while (_buckets[i].generation == _generation) {
+            i = (i + 1) & mask;
+        }
+        _buckets[i] = { _generation, static_cast<std::uint32_t>(index) };
+    }
+}
+
+std::size_t EventBus::_hash(_Entry const& entry) noexcept
+{
+    std::uint64_t h = reinterpret_cast<std::uintptr_t>(entry.subject);
+    h ^= (static_cast<std::uint64_t>(static_cast<std::uint32_t>(entry.id)) << 32)
+        ^ static_cast<std::uint32_t>(entry.charges);
+    h *= 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h ^ (h >> 29));
 }
 
-SSS_END;
\ No newline at end of file
+SSS_END;
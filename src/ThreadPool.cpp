@@ -0,0 +1,298 @@
+#include "Commons/ThreadPool.hpp"
+#include "Commons/log.hpp"
+
+SSS_BEGIN;
+
+// Pool the calling thread is a worker of, if any, and its index
+static thread_local ThreadPool const* _current_pool = nullptr;
+static thread_local std::size_t _current_index = 0;
+
+ThreadPool::ThreadPool(std::size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    _deques = std::make_unique<_Deque[]>(threads);
+    _threads.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        _threads.emplace_back(&ThreadPool::_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    // Held jobs are run too
+    setThrottled(false);
+    {
+        std::unique_lock const lock(_sleep_mutex);
+        _stopping = true;
+    }
+    _cv.notify_all();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Job job)
+{
+    submit(std::move(job), Priority::normal);
+}
+
+void ThreadPool::submit(Job job, Priority priority, Clock::time_point deadline)
+{
+    if (!job) {
+        return;
+    }
+    std::size_t const index = static_cast<std::size_t>(priority);
+    if (priority == Priority::normal && deadline == Clock::time_point::max() && isWorker()) {
+        _Deque& deque = _deques[_current_index];
+        std::unique_lock const lock(deque.mutex);
+        deque.jobs.emplace_back(std::move(job));
+    }
+    else {
+        std::unique_lock const lock(_shared.mutex);
+        std::vector<_Entry>& heap = _shared.heaps[index];
+        heap.push_back({ std::move(job), Clock::now(), deadline, _shared.seq++ });
+        std::push_heap(heap.begin(), heap.end(), _later);
+        _shared_queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    _queuedOne(index);
+    _submits.fetch_add(1);
+    _queued.fetch_add(1);
+    // Pairs with the increment of _sleepers in _loop(): either
+    // the sleeper sees the new job, or it is seen sleeping here
+    if (_sleepers.load() != 0) {
+        {
+            std::unique_lock const lock(_sleep_mutex);
+        }
+        _cv.notify_one();
+    }
+}
+
+bool ThreadPool::isWorker() const noexcept
+{
+    return _current_pool == this;
+}
+
+bool ThreadPool::runPending()
+{
+    Job job;
+    if (!_take(isWorker() ? _current_index : _threads.size(), job)) {
+        return false;
+    }
+    _run(job);
+    return true;
+}
+
+ThreadPool::Stats ThreadPool::stats(Priority priority) const noexcept
+{
+    _Counters const& counters = _stats[static_cast<std::size_t>(priority)];
+    Stats stats;
+    stats.pending = counters.pending.load(std::memory_order_relaxed);
+    stats.peak = counters.peak.load(std::memory_order_relaxed);
+    stats.submitted = counters.submitted.load(std::memory_order_relaxed);
+    stats.promoted = counters.promoted.load(std::memory_order_relaxed);
+    stats.late = counters.late.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ThreadPool::resetStats() noexcept
+{
+    for (_Counters& counters : _stats) {
+        counters.peak.store(counters.pending.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+        counters.submitted.store(0, std::memory_order_relaxed);
+        counters.promoted.store(0, std::memory_order_relaxed);
+        counters.late.store(0, std::memory_order_relaxed);
+    }
+}
+
+void ThreadPool::setAging(std::chrono::milliseconds step) noexcept
+{
+    _aging_ms.store(std::max<long long>(step.count(), 1), std::memory_order_relaxed);
+}
+
+std::chrono::milliseconds ThreadPool::getAging() const noexcept
+{
+    return std::chrono::milliseconds(_aging_ms.load(std::memory_order_relaxed));
+}
+
+void ThreadPool::setThrottled(bool throttled) noexcept
+{
+    if (_throttled.exchange(throttled) && !throttled) {
+        {
+            std::unique_lock const lock(_sleep_mutex);
+        }
+        _cv.notify_all();
+    }
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool instance;
+    return instance;
+}
+
+void ThreadPool::_loop(std::size_t index) noexcept
+{
+    _current_pool = this;
+    _current_index = index;
+    for (;;) {
+        Job job;
+        std::uint64_t const submits = _submits.load();
+        if (_take(index, job)) {
+            _run(job);
+            continue;
+        }
+        std::unique_lock lock(_sleep_mutex);
+        _sleepers.fetch_add(1);
+        // Held jobs don't wake workers up, but get promoted over time
+        auto const ready = [&] {
+            return _stopping || (_queued.load() != 0
+                && (!_throttled.load() || _submits.load() != submits));
+        };
+        if (_throttled.load()) {
+            _cv.wait_for(lock, getAging(), ready);
+        }
+        else {
+            _cv.wait(lock, ready);
+        }
+        _sleepers.fetch_sub(1);
+        if (_stopping && _queued.load() == 0) {
+            break;
+        }
+    }
+}
+
+bool ThreadPool::_take(std::size_t index, Job& job)
+{
+    if (_queued.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    auto const pop = [&](_Deque& deque, bool back) {
+        std::unique_lock const lock(deque.mutex);
+        if (deque.jobs.empty()) {
+            return false;
+        }
+        if (back) {
+            job = std::move(deque.jobs.back());
+            deque.jobs.pop_back();
+        }
+        else {
+            job = std::move(deque.jobs.front());
+            deque.jobs.pop_front();
+        }
+        _queued.fetch_sub(1, std::memory_order_relaxed);
+        _startedOne(static_cast<std::size_t>(Priority::normal));
+        return true;
+    };
+    std::size_t const count = _threads.size();
+    if (_takeShared(job, static_cast<std::size_t>(Priority::high))) {
+        return true;
+    }
+    if (index < count && pop(_deques[index], true)) {
+        return true;
+    }
+    if (_takeShared(job, priority_count)) {
+        return true;
+    }
+    for (std::size_t i = 1; i <= count; ++i) {
+        std::size_t const victim = (index + i) % count;
+        if (victim != index && pop(_deques[victim], false)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::_takeShared(Job& job, std::size_t max_class)
+{
+    if (_shared_queued.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    Clock::time_point const now = Clock::now();
+    Clock::duration const aging = getAging();
+    std::size_t const held = _throttled.load(std::memory_order_relaxed)
+        ? static_cast<std::size_t>(Priority::low) : priority_count;
+
+    std::unique_lock const lock(_shared.mutex);
+    // Pick the head with the lowest promoted class, then earliest deadline,
+    // then oldest, so that ties favor the work waiting the longest
+    std::size_t best = priority_count;
+    std::size_t best_class = priority_count;
+    for (std::size_t i = 0; i < priority_count; ++i) {
+        std::vector<_Entry> const& heap = _shared.heaps[i];
+        if (heap.empty()) {
+            continue;
+        }
+        _Entry const& head = heap.front();
+        std::size_t promoted = i - std::min<std::size_t>(i, (now - head.submitted) / aging);
+        if (head.deadline != Clock::time_point::max() && head.deadline - now <= aging) {
+            promoted = 0;
+        }
+        if (promoted >= held || promoted > max_class) {
+            continue;
+        }
+        if (best == priority_count || promoted < best_class
+            || (promoted == best_class && _later(_shared.heaps[best].front(), head)))
+        {
+            best = i;
+            best_class = promoted;
+        }
+    }
+    if (best == priority_count) {
+        return false;
+    }
+
+    std::vector<_Entry>& heap = _shared.heaps[best];
+    std::pop_heap(heap.begin(), heap.end(), _later);
+    _Entry& entry = heap.back();
+    job = std::move(entry.job);
+    if (best_class < best) {
+        _stats[best].promoted.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (entry.deadline < now) {
+        _stats[best].late.fetch_add(1, std::memory_order_relaxed);
+    }
+    heap.pop_back();
+    _shared_queued.fetch_sub(1, std::memory_order_relaxed);
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+    _startedOne(best);
+    return true;
+}
+
+bool ThreadPool::_later(_Entry const& a, _Entry const& b) noexcept
+{
+    return a.deadline != b.deadline ? a.deadline > b.deadline : a.seq > b.seq;
+}
+
+void ThreadPool::_queuedOne(std::size_t index) noexcept
+{
+    _Counters& counters = _stats[index];
+    counters.submitted.fetch_add(1, std::memory_order_relaxed);
+    std::size_t const pending = counters.pending.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::size_t peak = counters.peak.load(std::memory_order_relaxed);
+    while (pending > peak && !counters.peak.compare_exchange_weak(peak, pending,
+        std::memory_order_relaxed))
+    {
+    }
+}
+
+void ThreadPool::_startedOne(std::size_t index) noexcept
+{
+    _stats[index].pending.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ThreadPool::_run(Job& job) noexcept try
+{
+    job();
+}
+catch (std::exception const& e) {
+    // A failing job may be submitted over and over
+    LOG_EVERY_MS(1000) LOG_CTX_ERR("ThreadPool: Exception was caught", e.what());
+}
+catch (...) {
+    LOG_EVERY_MS(1000) LOG_ERR("ThreadPool: Unknown exception was caught");
+}
+
+SSS_END;
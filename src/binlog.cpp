@@ -0,0 +1,479 @@
+#include "Commons/binlog.hpp"
+#include <shared_mutex>
+
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+SSS_BEGIN;
+
+namespace Log::Binary {
+    INTERNAL_BEGIN;
+
+    // Layout of the file header
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t reserved;
+        std::int64_t offset_ns; // system_clock - steady_clock, in nanoseconds
+    };
+
+    // Layout of each record header, followed by its payload
+    struct RecordHeader {
+        std::uint32_t size;     // Whole record size, written last
+        std::uint32_t format_id;
+        std::int64_t time_ns;   // monotonicNS() stamp
+        std::uint32_t thread_id;
+        std::uint32_t reserved;
+    };
+
+    static constexpr char magic[8] = "SSSBLOG";
+    static constexpr std::uint32_t version = 1;
+    // Format ID of records registering a format string
+    static constexpr std::uint32_t format_definition = UINT32_MAX;
+    // Format ID of space claimed by a record which couldn't be written
+    static constexpr std::uint32_t padding = UINT32_MAX - 1;
+
+    static constexpr std::size_t align8(std::size_t size) noexcept
+    {
+        return (size + 7) & ~std::size_t(7);
+    }
+
+    // Owns the mapped file and the registered format strings
+    class BinaryFile {
+    public:
+        static BinaryFile& get() {
+            static BinaryFile instance;
+            return instance;
+        };
+
+        void open(std::string const& path, std::size_t chunk_size)
+        {
+            close();
+            {
+                // Same order as registerFormat(), which writes while locked
+                std::unique_lock const formats_lock(_formats_mutex);
+                std::unique_lock const lock(_mutex);
+                _chunk = align8(chunk_size > sizeof(FileHeader) ? chunk_size : sizeof(FileHeader));
+#if defined(_WIN32)
+                _file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                    NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (_file == INVALID_HANDLE_VALUE) {
+                    throw_exc("Could not open file \'" + path + "\'");
+                }
+#else
+                _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if (_fd < 0) {
+                    throw_exc("Could not open file \'" + path + "\' : " + getErrorString(errno));
+                }
+#endif
+                _file_open = true;
+                _map(_chunk);
+                using namespace std::chrono;
+                FileHeader header{ {}, version, 0,
+                    duration_cast<nanoseconds>(monotonicToSystem(0).time_since_epoch()).count() };
+                std::memcpy(header.magic, magic, sizeof(magic));
+                std::memcpy(_data, &header, sizeof(header));
+                _offset = sizeof(FileHeader);
+                // Write formats registered before the file was open,
+                // ahead of any record using them
+                for (std::uint32_t id = 0; id < _formats.size(); ++id) {
+                    _writeFormat(_append(format_definition, _formatSize(id)), id);
+                }
+                _open.store(true, std::memory_order_release);
+            }
+        };
+
+        void close() noexcept
+        {
+            std::unique_lock const lock(_mutex);
+            if (!_file_open) {
+                return;
+            }
+            _open.store(false, std::memory_order_release);
+            std::size_t const used = _offset.load() < _mapped ? _offset.load() : _mapped;
+            _unmap();
+#if defined(_WIN32)
+            LARGE_INTEGER size;
+            size.QuadPart = static_cast<LONGLONG>(used);
+            SetFilePointerEx(_file, size, NULL, FILE_BEGIN);
+            SetEndOfFile(_file);
+            CloseHandle(_file);
+            _file = INVALID_HANDLE_VALUE;
+#else
+            (void)::ftruncate(_fd, static_cast<off_t>(used));
+            ::close(_fd);
+            _fd = -1;
+#endif
+            _file_open = false;
+        };
+
+        inline bool isOpen() const noexcept {
+            return _open.load(std::memory_order_acquire);
+        };
+
+        std::uint32_t registerFormat(Level level, std::string_view format)
+        {
+            static constexpr std::string_view prefixes[] = { "", "[WRN]: ", "[ERR]: " };
+            std::unique_lock const lock(_formats_mutex);
+            std::uint32_t const id = static_cast<std::uint32_t>(_formats.size());
+            _formats.emplace_back(level, std::string(prefixes[static_cast<int>(level)]) + std::string(format));
+            if (char* dst = isOpen() ? beginRecord(format_definition, _formatSize(id)) : nullptr;
+                dst != nullptr)
+            {
+                _writeFormat(dst, id);
+                endRecord();
+            }
+            return id;
+        };
+
+        char* beginRecord(std::uint32_t format_id, std::size_t payload_size) noexcept try
+        {
+            if (!isOpen()) {
+                return nullptr;
+            }
+            std::size_t const size = align8(sizeof(RecordHeader) + payload_size);
+            _mutex.lock_shared();
+            if (!isOpen()) {
+                _mutex.unlock_shared();
+                return nullptr;
+            }
+            std::size_t const pos = _offset.fetch_add(size, std::memory_order_relaxed);
+            if (pos + size > _mapped) {
+                _mutex.unlock_shared();
+                try {
+                    _grow(pos + size);
+                }
+                catch (...) {
+                    _mutex.lock_shared();
+                    _pad(pos, size);
+                    _mutex.unlock_shared();
+                    throw;
+                }
+                _mutex.lock_shared();
+                if (!isOpen() || pos + size > _mapped) {
+                    _pad(pos, size);
+                    _mutex.unlock_shared();
+                    return nullptr;
+                }
+            }
+            RecordHeader header{ 0, format_id, monotonicNS(), threadID(), 0 };
+            std::memcpy(_data + pos, &header, sizeof(header));
+            _record = _data + pos;
+            _record_size = static_cast<std::uint32_t>(size);
+            return _record + sizeof(RecordHeader);
+        }
+        catch (...) {
+            return nullptr;
+        };
+
+        void endRecord() noexcept
+        {
+            // Size is written last, a zero size marks an incomplete record
+            std::atomic_ref<std::uint32_t>(*reinterpret_cast<std::uint32_t*>(_record))
+                .store(_record_size, std::memory_order_release);
+            _mutex.unlock_shared();
+        };
+
+    private:
+        BinaryFile()
+        {
+            // Built-in formats of SSS::log_msg, SSS::log_wrn & SSS::log_err
+            registerFormat(Level::msg, "{}");
+            registerFormat(Level::wrn, "{}");
+            registerFormat(Level::err, "{}");
+        };
+        ~BinaryFile() { close(); };
+
+        // Those write format definition records, _formats_mutex should be locked
+        std::size_t _formatSize(std::uint32_t id) const noexcept
+        {
+            return sizeof(std::uint32_t) + 1 + argSize(_formats[id].second);
+        };
+        void _writeFormat(char* dst, std::uint32_t id) noexcept
+        {
+            auto const& [level, format] = _formats[id];
+            std::memcpy(dst, &id, sizeof(id));
+            dst[sizeof(id)] = static_cast<char>(level);
+            writeStr(dst + sizeof(id) + 1, format);
+        };
+
+        // Appends a complete record while no other thread writes,
+        // _mutex should be locked. Returns its payload.
+        char* _append(std::uint32_t format_id, std::size_t payload_size)
+        {
+            std::size_t const pos = _offset;
+            std::size_t const size = align8(sizeof(RecordHeader) + payload_size);
+            if (pos + size > _mapped) {
+                std::size_t mapped = _mapped;
+                while (mapped < pos + size) {
+                    mapped += _chunk;
+                }
+                _unmap();
+                _map(mapped);
+            }
+            RecordHeader const header{ static_cast<std::uint32_t>(size), format_id, monotonicNS(), threadID(), 0 };
+            std::memcpy(_data + pos, &header, sizeof(header));
+            _offset = pos + size;
+            return _data + pos + sizeof(RecordHeader);
+        };
+
+        // Marks claimed space which won't hold a record as padding, so
+        // that decode() steps over it, _mutex should be locked (shared)
+        void _pad(std::size_t pos, std::size_t size) noexcept
+        {
+            if (_data == nullptr || pos + size > _mapped) {
+                return;
+            }
+            RecordHeader const header{ 0, padding, 0, 0, 0 };
+            std::memcpy(_data + pos, &header, sizeof(header));
+            std::atomic_ref<std::uint32_t>(*reinterpret_cast<std::uint32_t*>(_data + pos))
+                .store(static_cast<std::uint32_t>(size), std::memory_order_release);
+        };
+
+        void _grow(std::size_t min_size)
+        {
+            std::unique_lock const lock(_mutex);
+            if (!isOpen() || min_size <= _mapped) {
+                return;
+            }
+            std::size_t size = _mapped;
+            while (size < min_size) {
+                size += _chunk;
+            }
+            _unmap();
+            _map(size);
+        };
+
+        void _map(std::size_t size)
+        {
+#if defined(_WIN32)
+            _mapping = CreateFileMappingA(_file, NULL, PAGE_READWRITE,
+                static_cast<DWORD>(static_cast<std::uint64_t>(size) >> 32),
+                static_cast<DWORD>(size), NULL);
+            if (_mapping != NULL) {
+                _data = static_cast<char*>(MapViewOfFile(_mapping, FILE_MAP_WRITE, 0, 0, size));
+            }
+#else
+            if (::ftruncate(_fd, static_cast<off_t>(size)) == 0) {
+                void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+                _data = ptr != MAP_FAILED ? static_cast<char*>(ptr) : nullptr;
+            }
+#endif
+            if (_data == nullptr) {
+                _open.store(false, std::memory_order_release);
+                throw_exc("Could not map binary log file");
+            }
+            _mapped = size;
+        };
+
+        void _unmap() noexcept
+        {
+#if defined(_WIN32)
+            if (_data != nullptr) {
+                UnmapViewOfFile(_data);
+            }
+            if (_mapping != NULL) {
+                CloseHandle(_mapping);
+                _mapping = NULL;
+            }
+#else
+            if (_data != nullptr) {
+                ::munmap(_data, _mapped);
+            }
+#endif
+            _data = nullptr;
+            _mapped = 0;
+        };
+
+        // Shared while writing records, unique while (un)mapping
+        std::shared_mutex _mutex;
+        std::atomic<bool> _open{ false };
+        std::atomic<std::size_t> _offset{ 0 };
+        char* _data{ nullptr };
+        std::size_t _mapped{ 0 };
+        std::size_t _chunk{ 0 };
+#if defined(_WIN32)
+        HANDLE _file{ INVALID_HANDLE_VALUE };
+        HANDLE _mapping{ NULL };
+#else
+        int _fd{ -1 };
+#endif
+        bool _file_open{ false };
+
+        std::mutex _formats_mutex;
+        std::vector<std::pair<Level, std::string>> _formats;
+
+        // Record being written by the calling thread
+        static thread_local char* _record;
+        static thread_local std::uint32_t _record_size;
+    };
+
+    thread_local char* BinaryFile::_record{ nullptr };
+    thread_local std::uint32_t BinaryFile::_record_size{ 0 };
+
+    std::uint32_t threadID() noexcept
+    {
+        static std::atomic<std::uint32_t> counter{ 0 };
+        thread_local std::uint32_t const id = counter.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    std::uint32_t registerFormat(Level level, std::string_view format)
+    {
+        return BinaryFile::get().registerFormat(level, format);
+    }
+
+    char* beginRecord(std::uint32_t format_id, std::size_t payload_size) noexcept
+    {
+        return BinaryFile::get().beginRecord(format_id, payload_size);
+    }
+
+    void endRecord() noexcept
+    {
+        BinaryFile::get().endRecord();
+    }
+
+    bool writeText(Level level, std::string_view str) noexcept
+    {
+        char* dst = beginRecord(static_cast<std::uint32_t>(level), argSize(str));
+        if (dst == nullptr) {
+            return false;
+        }
+        writeStr(dst, str);
+        endRecord();
+        return true;
+    }
+
+    // Reads a value of type V, throws if out of bounds
+    template <typename V>
+    static V read(char const*& src, char const* end)
+    {
+        if (end - src < static_cast<std::ptrdiff_t>(sizeof(V))) {
+            throw_exc("Truncated record");
+        }
+        V value;
+        std::memcpy(&value, src, sizeof(V));
+        src += sizeof(V);
+        return value;
+    }
+
+    // Reads a tagged argument and converts it to text
+    static std::string readArg(char const*& src, char const* end)
+    {
+        switch (static_cast<Tag>(read<std::uint8_t>(src, end))) {
+        case Tag::i64:      return toString(read<std::int64_t>(src, end));
+        case Tag::u64:      return toString(read<std::uint64_t>(src, end));
+        case Tag::f64:      return toString(read<double>(src, end));
+        case Tag::boolean:  return toString(read<std::uint8_t>(src, end) != 0);
+        case Tag::ptr:
+            return toString(reinterpret_cast<void const*>(
+                static_cast<std::uintptr_t>(read<std::uint64_t>(src, end))));
+        case Tag::str: {
+            std::uint32_t const size = read<std::uint32_t>(src, end);
+            if (end - src < static_cast<std::ptrdiff_t>(size)) {
+                throw_exc("Truncated record");
+            }
+            std::string ret(src, size);
+            src += size;
+            return ret;
+        }
+        }
+        throw_exc("Unknown argument tag");
+    }
+
+    INTERNAL_END;
+
+    void open(std::string const& path, std::size_t chunk_size)
+    {
+        _internal::BinaryFile::get().open(path, chunk_size);
+    }
+
+    void close() noexcept
+    {
+        _internal::BinaryFile::get().close();
+    }
+
+    bool isOpen() noexcept
+    {
+        return _internal::BinaryFile::get().isOpen();
+    }
+
+    void decode(std::string const& path, std::ostream& out, bool thread_ids) try
+    {
+        using namespace _internal;
+        using namespace std::chrono;
+
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream.is_open()) {
+            throw_exc("Could not open file \'" + path + "\' : " + getErrorString(errno));
+        }
+        std::vector<char> const data{ std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+
+        FileHeader header;
+        if (data.size() < sizeof(header)
+            || (std::memcpy(&header, data.data(), sizeof(header)), std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+            || header.version != version)
+        {
+            throw_exc("\'" + path + "\' is not a binary log file");
+        }
+
+        std::vector<std::string> formats;
+        std::string line;
+        char const* pos = data.data() + sizeof(FileHeader);
+        char const* const end = data.data() + data.size();
+        while (end - pos >= static_cast<std::ptrdiff_t>(sizeof(RecordHeader))) {
+            RecordHeader record;
+            std::memcpy(&record, pos, sizeof(record));
+            // Incomplete or unused space, end of the log
+            if (record.size < sizeof(RecordHeader) || end - pos < static_cast<std::ptrdiff_t>(record.size)) {
+                break;
+            }
+            char const* src = pos + sizeof(RecordHeader);
+            char const* const record_end = pos + record.size;
+            pos = record_end;
+            if (record.format_id == padding) {
+                continue;
+            }
+
+            if (record.format_id == format_definition) {
+                std::uint32_t const id = read<std::uint32_t>(src, record_end);
+                read<std::uint8_t>(src, record_end);
+                if (formats.size() <= id) {
+                    formats.resize(id + 1);
+                }
+                formats[id] = readArg(src, record_end);
+                continue;
+            }
+            if (record.format_id >= formats.size()) {
+                continue;
+            }
+
+            system_clock::time_point const time(duration_cast<system_clock::duration>(
+                nanoseconds(record.time_ns + header.offset_ns)));
+            line = cachedTimeUTF(time);
+            line += "| ";
+            if (thread_ids) {
+                line += "[T" + toString(record.thread_id) + "] ";
+            }
+            std::string_view format = formats[record.format_id];
+            while (src < record_end && *src != 0) {
+                std::size_t const brackets = format.find("{}");
+                line += format.substr(0, brackets);
+                line += readArg(src, record_end);
+                format.remove_prefix(brackets == format.npos ? format.size() : brackets + 2);
+            }
+            line += format;
+            line += '\n';
+            out << line;
+        }
+        out.flush();
+    }
+    CATCH_AND_RETHROW_FUNC_EXC;
+}
+
+SSS_END;
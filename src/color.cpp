@@ -26,9 +26,9 @@ RGB24::RGB24(const glm::vec4& c)
 
 std::string RGB24::to_string() const
 {
-    char buff[64];
-    sprintf_s(buff, "0x%06X (RGB: %d, %d, %d)", rgb, r, g, b);
-    return buff;
+    std::string ret;
+    toString(ret, *this);
+    return ret;
 }
 
 RGB24::operator std::string() const
@@ -68,9 +68,9 @@ RGBA32::RGBA32(const glm::vec4& c)
 
 std::string RGBA32::to_string() const
 {
-    char buff[64];
-    sprintf_s(buff, "0x%08X (RGBA: %d, %d, %d, %d)", rgba, r, g, b, a);
-    return buff;
+    std::string ret;
+    toString(ret, *this);
+    return ret;
 }
 
 RGBA32::operator std::string() const
@@ -134,11 +134,9 @@ RGBA32& operator*=(RGBA32& dst, RGBA32 const& src) noexcept
 /* Float colors */
 std::string RGBA_f::to_string() const
 {
-    return std::string{ "(RGBA: "
-        + std::format("{:.3f}", _col.r) +
-        ", " + std::format("{:.3f}", _col.r) +
-        ", " + std::format("{:.3f}", _col.r) +
-        ", " + std::format("{:.3f}", _col.r) };
+    std::string ret;
+    toString(ret, *this);
+    return ret;
 }
 
 RGBA_f::operator std::string() const
@@ -338,4 +336,33 @@ RGBA_f mix(const RGBA_f& a, const RGBA_f& b, float t) noexcept
     return RGBA_f::from_Oklab(glm::mix(a.to_Oklab(), b.to_Oklab(), t));
 }
 
+// Formats into a stack buffer, then appends it
+void toString(std::string& out, RGB24 const& color)
+{
+    char buff[64];
+    int const size = sprintf_s(buff, "0x%06X (RGB: %d, %d, %d)",
+        color.rgb, color.r, color.g, color.b);
+    if (size > 0) {
+        out.append(buff, size);
+    }
+}
+
+// Formats into a stack buffer, then appends it
+void toString(std::string& out, RGBA32 const& color)
+{
+    char buff[64];
+    int const size = sprintf_s(buff, "0x%08X (RGBA: %d, %d, %d, %d)",
+        color.rgba, color.r, color.g, color.b, color.a);
+    if (size > 0) {
+        out.append(buff, size);
+    }
+}
+
+// Formats directly at the end of the given string
+void toString(std::string& out, RGBA_f const& color)
+{
+    std::format_to(std::back_inserter(out), "(RGBA: {:.3f}, {:.3f}, {:.3f}, {:.3f})",
+        color._col.r, color._col.g, color._col.b, color._col.a);
+}
+
 SSS_END;
\ No newline at end of file
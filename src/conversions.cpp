@@ -1,5 +1,11 @@
 #include "Commons/conversions.hpp"
 #include <codecvt>
+#include <typeindex>
+#include <unordered_map>
+#include <shared_mutex>
+#if defined(__GNUG__)
+# include <cxxabi.h>
+#endif
 
 SSS_BEGIN;
 
@@ -26,4 +32,54 @@ std::string str32ToStr(std::u32string const& str)
 
 #pragma warning(pop)
 
+// Converts the implementation defined type name to a readable one
+static std::string _demangle(char const* name)
+{
+#if defined(__GNUG__)
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    std::string ret(status == 0 && demangled != nullptr ? demangled : name);
+    std::free(demangled);
+    return ret;
+#else
+    std::string ret(name);
+    for (std::string_view const keyword : { "class ", "struct ", "enum ", "union ", " __ptr64" }) {
+        for (std::size_t pos = ret.find(keyword); pos != ret.npos; pos = ret.find(keyword, pos)) {
+            ret.erase(pos, keyword.size());
+        }
+    }
+    return ret;
+#endif
+}
+
+std::string_view typeName(std::type_info const& info)
+{
+    // Most calls come from the same type in a row (eg: logging an object)
+    thread_local std::type_info const* last_info = nullptr;
+    thread_local std::string_view last_name;
+    if (last_info == &info) {
+        return last_name;
+    }
+
+    // Map nodes are never moved, hence interned names stay valid
+    static std::shared_mutex mutex;
+    static std::unordered_map<std::type_index, std::string> names;
+
+    std::string_view name;
+    {
+        std::shared_lock const lock(mutex);
+        if (auto const it = names.find(info); it != names.cend()) {
+            name = it->second;
+        }
+    }
+    if (name.empty()) {
+        std::string demangled = _demangle(info.name());
+        std::unique_lock const lock(mutex);
+        name = names.try_emplace(info, std::move(demangled)).first->second;
+    }
+    last_info = &info;
+    last_name = name;
+    return name;
+}
+
 SSS_END;
\ No newline at end of file
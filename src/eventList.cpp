@@ -2,13 +2,13 @@
 
 SSS_BEGIN;
 
-inline std::vector<std::string> EventManager::eventList()
+std::vector<std::string> EventManager::eventList()
 {
 	std::vector<std::string> list;
 	std::string tmp;
-	for (const std::pair<std::string, int>& e : get()._eventlist)
+	for (const std::pair<const int, std::string>& e : get()._eventlist)
 	{
-		tmp = "Event[" + e.first + "] : " + std::to_string(e.second);
+		tmp = "Event[" + e.second + "] : " + std::to_string(e.first);
 		list.push_back(tmp);
 	}
 	return list;
@@ -16,34 +16,58 @@ inline std::vector<std::string> EventManager::eventList()
 
 void EventManager::registerEvent(const std::string &eventName)
 {
-	if (get()._eventlist.contains(eventName))
+	const int id = eventHash(eventName);
+	auto const [it, inserted] = get()._eventlist.try_emplace(id, eventName);
+	if (!inserted)
 	{
-		SSS::log_wrn("EVENT : [" + eventName + "] Already registered, risk of conflict");
+		if (it->second != eventName) {
+			// Emitting either name would reach the other's observers
+			SSS::throw_exc("EVENT : [" + eventName + "] ID " + SSS::toString(id)
+				+ " collides with [" + it->second + "], rename one of them");
+		}
+		SSS::log_wrn("EVENT : [" + eventName + "] Already registered");
 		return;
 	}
-	
-	get()._eventlist[eventName] = static_cast<int>(get()._eventlist.size());
-	SSS::log_msg("EVENT : [" + eventName + "] "+SSS::toString(get()._eventlist[eventName])+ " Correctly registered");
+	SSS::log_msg("EVENT : [" + eventName + "] " + SSS::toString(id) + " Correctly registered");
 }
 
 int EventManager::eventID(const std::string& eventName)
 {
-	if (!get()._eventlist.contains(eventName)) {
-		SSS::log_err("EVENT : [" + eventName + "] doesn't exist, or isn't registered");
+	const int id = eventHash(eventName);
+	auto const it = get()._eventlist.find(id);
+	if (it == get()._eventlist.cend() || it->second != eventName) {
+		LOG_EVERY_MS(1000) SSS::log_err("EVENT : [" + eventName + "] doesn't exist, or isn't registered");
 		return INT32_MAX;
 	}
+	return id;
+}
 
-	return get()._eventlist[eventName];
+int EventManager::checkEmitted(int id, std::string_view eventName)
+{
+	// Names from strings were checked by eventID() already
+	if (id == INT32_MAX)
+		return id;
+	auto const it = get()._eventlist.find(id);
+	if (it == get()._eventlist.cend() || it->second != eventName) {
+		LOG_EVERY_MS(1000) SSS::log_err("EVENT : [" + std::string(eventName) + "] emitted, but isn't registered");
+	}
+	return id;
+}
+
+std::vector<int> EventManager::eventIDs(std::initializer_list<std::string> eventNames)
+{
+	std::vector<int> ids;
+	ids.reserve(eventNames.size());
+	for (const std::string& name : eventNames)
+		ids.push_back(eventID(name));
+	return ids;
 }
 
 std::string EventManager::findName(const int& id)
 {
-	std::string tmp;
-	for (const std::pair<std::string, int>& e : get()._eventlist)
-	{
-		if (e.second == id)
-			return "Event<"+e.first+"> id :"+ SSS::toString(id);
-	}
+	auto const it = get()._eventlist.find(id);
+	if (it != get()._eventlist.cend())
+		return "Event<"+it->second+"> id :"+ SSS::toString(id);
 	return "Unknown Event["+SSS::toString(id)+"]";
 }
 
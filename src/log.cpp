@@ -1,19 +1,413 @@
 #include "Commons/log.hpp"
+#include "Commons/lockfree.hpp"
+#include "Commons/binlog.hpp"
+#include "Commons/logsink.hpp"
 
 SSS_BEGIN;
 
-// Logs the given argument to the given stream
-static void _log(std::ostream& stream, std::string const& str) noexcept try
+// Appends a full log line, as written to sinks
+static void _formatLine(std::string& line, std::chrono::system_clock::time_point time,
+    Log::Level level, std::string_view str)
 {
-    static std::mutex mutex;
-    std::unique_lock const lock(mutex);
+    line += cachedTimeUTF(time);
+    line += "| ";
+    switch (level) {
+    case Log::Level::msg: break;
+    case Log::Level::wrn: line += "[WRN]: "; break;
+    case Log::Level::err: line += "[ERR]: "; break;
+    }
+    line += str;
+    line += '\n';
+}
+
+namespace Log {
+    INTERNAL_BEGIN;
+
+    // Message waiting in the asynchronous queue, its raw
+    // monotonic time stamp is only formatted by the writer
+    struct LogRecord {
+        Level level{ Level::msg };
+        long long time{ 0 };
+        std::string str;
+    };
+
+    // Owns the asynchronous queue and its writer thread
+    class LogWriter {
+    public:
+        static LogWriter& get() {
+            static LogWriter instance;
+            return instance;
+        };
+
+        void enable(std::size_t capacity, Overflow policy)
+        {
+            std::unique_lock const lock(_state_mutex);
+            if (!_queue) {
+                _queue = std::make_unique<RingQueue<LogRecord>>(capacity);
+            }
+            _policy = policy;
+            if (!_thread.joinable()) {
+                _running = true;
+                _thread = std::thread(&LogWriter::_loop, this);
+            }
+            _enabled.store(true, std::memory_order_release);
+        };
+
+        void disable() noexcept
+        {
+            std::unique_lock const lock(_state_mutex);
+            _enabled.store(false, std::memory_order_release);
+            if (_thread.joinable()) {
+                {
+                    std::unique_lock const cv_lock(_cv_mutex);
+                    _running = false;
+                }
+                _cv.notify_one();
+                _thread.join();
+            }
+            // Pairs with the fence in push()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            drain();
+        };
+
+        inline bool enabled() const noexcept {
+            return _enabled.load(std::memory_order_acquire);
+        };
+
+        inline std::size_t dropped() const noexcept {
+            return _dropped.load(std::memory_order_relaxed);
+        };
+
+        // Returns false if the record couldn't be queued and should be written directly
+        bool push(LogRecord& record) noexcept
+        {
+            while (!_queue->tryPush(record)) {
+                switch (_policy.load(std::memory_order_relaxed)) {
+                case Overflow::drop_newest:
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                case Overflow::drop_oldest: {
+                    LogRecord oldest;
+                    if (_queue->tryPop(oldest)) {
+                        _dropped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    break;
+                }
+                case Overflow::block:
+                    if (!enabled()) {
+                        return false;
+                    }
+                    _wake();
+                    std::this_thread::yield();
+                    break;
+                }
+            }
+            // Either disable() drains this record, or it already
+            // drained for the last time and the record is written here
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!enabled()) {
+                drain();
+                return true;
+            }
+            if (_sleeping) {
+                _wake();
+            }
+            return true;
+        };
+
+        // Writes all queued records from the calling thread, returns false if none
+        bool drain() noexcept try
+        {
+            if (!_queue) {
+                return false;
+            }
+            std::unique_lock const lock(_drain_mutex);
+            bool written = false;
+            LogRecord record;
+            while (_queue->tryPop(record)) {
+                _line.clear();
+                _formatLine(_line, monotonicToSystem(record.time), record.level, record.str);
+                dispatch(record.level, _line, false);
+                written = true;
+            }
+            if (written) {
+                endBatch();
+            }
+            return written;
+        }
+        catch (...) {
+            return false;
+        };
+
+    private:
+        // Sinks are used when destroyed, hence need to outlive the writer
+        LogWriter() { consoleSink(); };
+        ~LogWriter() { disable(); };
+
+        void _loop() noexcept
+        {
+            for (;;) {
+                if (drain()) {
+                    continue;
+                }
+                std::unique_lock lock(_cv_mutex);
+                if (!_running) {
+                    break;
+                }
+                _sleeping = true;
+                if (_queue->empty()) {
+                    _cv.wait_for(lock, std::chrono::milliseconds(10));
+                }
+                _sleeping = false;
+            }
+        };
+
+        void _wake() noexcept
+        {
+            {
+                std::unique_lock const lock(_cv_mutex);
+            }
+            _cv.notify_one();
+        };
+
+        std::unique_ptr<RingQueue<LogRecord>> _queue;
+        std::atomic<Overflow> _policy{ Overflow::block };
+        std::atomic<bool> _enabled{ false };
+        std::atomic<std::size_t> _dropped{ 0 };
+
+        std::mutex _state_mutex;
+        std::thread _thread;
+        bool _running{ false };
+        std::mutex _cv_mutex;
+        std::condition_variable _cv;
+        std::atomic<bool> _sleeping{ false };
+
+        std::mutex _drain_mutex;
+        std::string _line;
+    };
+
+    // Fixed-size ring of the most recent messages. Writers claim a slot
+    // with a single fetch_add, and keep its sequence odd while copying
+    // so that readers can detect and skip torn records (seqlock).
+    class FlightRing {
+    public:
+        static FlightRing& get() {
+            static FlightRing instance;
+            return instance;
+        };
+
+        // Those return whether silenced messages should now be captured
+        bool enable(std::size_t capacity)
+        {
+            std::unique_lock const lock(_state_mutex);
+            if (!_slots) {
+                _mask = std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1;
+                _slots = std::make_unique<_Slot[]>(_mask + 1);
+            }
+            _enabled.store(true, std::memory_order_release);
+            return _capture;
+        };
+
+        bool disable() noexcept
+        {
+            std::unique_lock const lock(_state_mutex);
+            _enabled.store(false, std::memory_order_release);
+            return false;
+        };
+
+        inline bool enabled() const noexcept {
+            return _enabled.load(std::memory_order_acquire);
+        };
+
+        bool captureSilenced(bool state) noexcept
+        {
+            std::unique_lock const lock(_state_mutex);
+            _capture = state;
+            return _capture && enabled();
+        };
+
+        std::atomic<bool> dump_on_error{ true };
+
+        void record(Level level, std::string_view str) noexcept
+        {
+            std::uint64_t const idx = _head.fetch_add(1, std::memory_order_relaxed);
+            _Slot& slot = _slots[idx & _mask];
+            std::uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+            // Give up if a lapped writer still holds the slot, or a newer one took it
+            if ((seq & 1) != 0 || seq > 2 * idx
+                || !slot.seq.compare_exchange_strong(seq, 2 * idx + 1, std::memory_order_relaxed))
+            {
+                return;
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+
+            std::size_t const size = std::min(str.size(), FlightRecorder::max_length);
+            slot.time.store(monotonicNS(), std::memory_order_relaxed);
+            slot.info.store(static_cast<std::uint64_t>(level) << 32 | size, std::memory_order_relaxed);
+            for (std::size_t i = 0; i * 8 < size; ++i) {
+                std::uint64_t word = 0;
+                std::memcpy(&word, str.data() + i * 8, std::min<std::size_t>(8, size - i * 8));
+                slot.text[i].store(word, std::memory_order_relaxed);
+            }
+            slot.seq.store(2 * idx + 2, std::memory_order_release);
+        };
+
+        // Writes all records published since the last dump,
+        // to the given stream or to all sinks if null
+        void dump(std::ostream* stream)
+        {
+            std::unique_lock const lock(_dump_mutex);
+            if (!_slots) {
+                return;
+            }
+            std::uint64_t const head = _head.load(std::memory_order_acquire);
+            std::uint64_t const capacity = _mask + 1;
+            std::uint64_t const first = std::max(_dumped, head > capacity ? head - capacity : 0);
+            _dumped = head;
+
+            std::string out;
+            std::size_t count = 0;
+            char text[FlightRecorder::max_length];
+            for (std::uint64_t idx = first; idx < head; ++idx) {
+                _Slot const& slot = _slots[idx & _mask];
+                std::uint64_t const seq = slot.seq.load(std::memory_order_acquire);
+                if (seq != 2 * idx + 2) {
+                    continue;
+                }
+                long long const time = slot.time.load(std::memory_order_relaxed);
+                std::uint64_t const info = slot.info.load(std::memory_order_relaxed);
+                std::size_t const size = std::min<std::size_t>(info & 0xFFFFFFFF, sizeof(text));
+                for (std::size_t i = 0; i * 8 < size; ++i) {
+                    std::uint64_t const word = slot.text[i].load(std::memory_order_relaxed);
+                    std::memcpy(text + i * 8, &word, std::min<std::size_t>(8, size - i * 8));
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) != seq) {
+                    continue;
+                }
+                _formatLine(out, monotonicToSystem(time), static_cast<Level>(info >> 32),
+                    std::string_view(text, size));
+                ++count;
+            }
+            if (count == 0) {
+                return;
+            }
+            out.insert(0, "=== Flight recorder: last " + toString(count) + " messages ===\n");
+            out += "=== End of flight recorder ===\n";
+
+            LogWriter::get().drain();
+            if (stream != nullptr) {
+                stream->write(out.data(), static_cast<std::streamsize>(out.size())).flush();
+            }
+            else {
+                dispatch(Level::err, out);
+            }
+        };
+
+    private:
+        // Sinks may be used when dumping, hence need to outlive the ring
+        FlightRing() { consoleSink(); };
+
+        struct alignas(cache_line_size) _Slot {
+            std::atomic<std::uint64_t> seq{ 0 };
+            std::atomic<long long> time{ 0 };
+            std::atomic<std::uint64_t> info{ 0 };
+            std::atomic<std::uint64_t> text[FlightRecorder::max_length / 8];
+        };
+
+        std::mutex _state_mutex;
+        std::atomic<bool> _enabled{ false };
+        bool _capture{ false };
+        std::uint64_t _mask{ 0 };
+        std::unique_ptr<_Slot[]> _slots;
+        alignas(cache_line_size) std::atomic<std::uint64_t> _head{ 0 };
 
-    if (!str.empty()) {
-        stream
-            << timeUTF() << "| "    // Print UTF time
-            << str                  // Print message
-            << std::endl;           // Print line break
+        std::mutex _dump_mutex;
+        std::uint64_t _dumped{ 0 };
+    };
+
+    INTERNAL_END;
+}
+
+// Number of nested #LOG_IF guards on this thread whose
+// messages should only reach the flight recorder
+static thread_local int _record_only_depth = 0;
+
+void _internal::LogGuard::_recordOnly(bool state) noexcept
+{
+    _record_only_depth += state ? 1 : -1;
+}
+
+
+// Formats the given argument once, then hands it to all sinks
+static void _logText(Log::Level level, std::string const& str) noexcept try
+{
+    if (str.empty() && level == Log::Level::msg) {
+        return;
+    }
+
+    // Sinks logging from the writer thread could wait for themselves
+    Log::_internal::LogWriter& writer = Log::_internal::LogWriter::get();
+    if (writer.enabled() && !Log::_internal::isDispatching()) {
+        Log::_internal::LogRecord record{ level, monotonicNS(), str };
+        if (writer.push(record)) {
+            return;
+        }
+    }
+
+    thread_local std::string line;
+    line.clear();
+    _formatLine(line, std::chrono::system_clock::now(), level, str);
+    Log::_internal::dispatch(level, line);
+}
+catch (...) {
+}
+
+// Logs the given argument as a binary record if possible, or as text
+static void _log(Log::Level level, std::string const& str) noexcept try
+{
+    Log::_internal::FlightRing& ring = Log::_internal::FlightRing::get();
+    if (ring.enabled()) {
+        // Dumps the history leading to the error, which is logged right after
+        if (level == Log::Level::err && _record_only_depth == 0
+            && ring.dump_on_error.load(std::memory_order_relaxed))
+        {
+            ring.dump(nullptr);
+        }
+        ring.record(level, str);
+    }
+    if (_record_only_depth != 0) {
+        return;
     }
+
+    if (Log::Binary::isOpen() && Log::Binary::_internal::writeText(level, str)) {
+        return;
+    }
+    _logText(level, str);
+}
+catch (...) {
+}
+
+// Logs "file.cpp:42: suppressed 12,345 similar messages"
+void _internal::RateGuard::_logSuppressed(std::uint64_t count, char const* file, int line) noexcept try
+{
+    std::string_view name(file);
+    if (std::size_t const pos = name.find_last_of("/\\"); pos != name.npos) {
+        name.remove_prefix(pos + 1);
+    }
+    std::string str(name);
+    str += ':';
+    str += toString(line);
+    str += ": suppressed ";
+    std::string const digits = toString(count);
+    for (std::size_t i = 0; i < digits.size(); ++i) {
+        if (i != 0 && (digits.size() - i) % 3 == 0) {
+            str += ',';
+        }
+        str += digits[i];
+    }
+    str += count == 1 ? " similar message" : " similar messages";
+    _log(Log::Level::wrn, str);
 }
 catch (...) {
 }
@@ -21,19 +415,94 @@ catch (...) {
 // Logs the given argument to std::cout
 void log_msg(std::string const& str) noexcept
 {
-    _log(std::cout, str);
+    _log(Log::Level::msg, str);
 }
 
 // Logs the given argument to std::cerr
 void log_wrn(std::string const& str) noexcept
 {
-    _log(std::cerr, CONTEXT_MSG("[WRN]", str));
+    _log(Log::Level::wrn, str);
 }
 
 // Logs the given argument to std::cerr
 void log_err(std::string const& str) noexcept
 {
-    _log(std::cerr, CONTEXT_MSG("[ERR]", str));
+    _log(Log::Level::err, str);
+}
+
+Log::_internal::Registry::_Word Log::_internal::Registry::_words[];
+
+// Own states & parent of each slot, guarded by _registry_mutex
+static std::mutex _registry_mutex;
+static std::size_t _registry_count = 0;
+static std::size_t _registry_parents[Log::_internal::Registry::max_slots];
+static std::uint8_t _registry_states[Log::_internal::Registry::max_slots];
+
+std::size_t Log::_internal::Registry::allocate(std::atomic<std::size_t>& slot,
+    std::size_t parent) noexcept
+{
+    {
+        std::unique_lock const lock(_registry_mutex);
+        std::size_t allocated = slot.load(std::memory_order_relaxed);
+        if (allocated != unallocated) {
+            return allocated;
+        }
+        if (_registry_count != max_slots) {
+            allocated = _registry_count++;
+            _registry_parents[allocated] = parent == no_parent ? allocated : parent;
+            _set(allocated, 0, false);
+            slot.store(allocated, std::memory_order_release);
+            return allocated;
+        }
+        // Often called during static initialization, where throwing terminates
+        slot.store(parent == no_parent ? 0 : parent, std::memory_order_release);
+    }
+    log_err("Too many log structures, maximum is " + toString(max_slots)
+        + ", sharing the parent's states");
+    return slot.load(std::memory_order_relaxed);
+}
+
+void Log::_internal::Registry::silence(std::size_t slot, bool state)
+{
+    std::unique_lock const lock(_registry_mutex);
+    _set(slot, silenced_bit, state);
+}
+
+void Log::_internal::Registry::louden(std::size_t slot, bool state)
+{
+    std::unique_lock const lock(_registry_mutex);
+    _set(slot, loudened_bit, state);
+}
+
+// Updates the own state of given slot, then recomputes the effective
+// bits of all slots from there. Parents are always allocated before
+// their children, so a single pass in slot order is enough.
+void Log::_internal::Registry::_set(std::size_t slot, std::uint64_t bit, bool state)
+{
+    if (state) {
+        _registry_states[slot] |= static_cast<std::uint8_t>(bit);
+    }
+    else {
+        _registry_states[slot] &= static_cast<std::uint8_t>(~bit);
+    }
+    for (std::size_t word = slot / slots_per_word; word * slots_per_word < _registry_count; ++word) {
+        std::uint64_t value = _words[word].value.load(std::memory_order_relaxed);
+        std::size_t const end = std::min((word + 1) * slots_per_word, _registry_count);
+        for (std::size_t i = std::max(word * slots_per_word, slot); i < end; ++i) {
+            std::size_t const parent = _registry_parents[i];
+            std::uint64_t bits = _registry_states[i];
+            if (parent != i) {
+                // Parent may sit in the word being computed
+                std::uint64_t const parent_bits = parent / slots_per_word == word
+                    ? value >> (2 * (parent % slots_per_word))
+                    : _bits(parent);
+                bits |= parent_bits & (silenced_bit | loudened_bit);
+            }
+            std::size_t const shift = 2 * (i % slots_per_word);
+            value = (value & ~((silenced_bit | loudened_bit) << shift)) | (bits << shift);
+        }
+        _words[word].value.store(value, std::memory_order_release);
+    }
 }
 
 std::string getErrorString(int errnum)
@@ -46,7 +515,81 @@ std::string getErrorString(int errnum)
 // Throws a runtime_error exception with given arg
 void throw_exc(std::string const& str)
 {
+    if (Log::FlightRecorder::isEnabled()
+        && Log::_internal::FlightRing::get().dump_on_error.load(std::memory_order_relaxed))
+    {
+        Log::FlightRecorder::dump();
+    }
     throw std::runtime_error(str);
 }
 
-SSS_END;
\ No newline at end of file
+void Log::enableAsync(std::size_t capacity, Overflow policy)
+{
+    _internal::LogWriter::get().enable(capacity, policy);
+}
+
+void Log::disableAsync() noexcept
+{
+    _internal::LogWriter::get().disable();
+}
+
+bool Log::isAsync() noexcept
+{
+    return _internal::LogWriter::get().enabled();
+}
+
+std::size_t Log::droppedCount() noexcept
+{
+    return _internal::LogWriter::get().dropped();
+}
+
+void Log::flush() noexcept try
+{
+    _internal::LogWriter::get().drain();
+    _internal::flushSinks();
+}
+catch (...) {
+}
+
+std::atomic<bool> Log::FlightRecorder::_capture_silenced{ false };
+
+void Log::FlightRecorder::enable(std::size_t capacity)
+{
+    _capture_silenced.store(_internal::FlightRing::get().enable(capacity), std::memory_order_relaxed);
+}
+
+void Log::FlightRecorder::disable() noexcept
+{
+    _capture_silenced.store(_internal::FlightRing::get().disable(), std::memory_order_relaxed);
+}
+
+bool Log::FlightRecorder::isEnabled() noexcept
+{
+    return _internal::FlightRing::get().enabled();
+}
+
+void Log::FlightRecorder::captureSilenced(bool state) noexcept
+{
+    _capture_silenced.store(_internal::FlightRing::get().captureSilenced(state), std::memory_order_relaxed);
+}
+
+void Log::FlightRecorder::dumpOnError(bool state) noexcept
+{
+    _internal::FlightRing::get().dump_on_error.store(state, std::memory_order_relaxed);
+}
+
+void Log::FlightRecorder::dump() noexcept try
+{
+    _internal::FlightRing::get().dump(nullptr);
+}
+catch (...) {
+}
+
+void Log::FlightRecorder::dump(std::ostream& stream) noexcept try
+{
+    _internal::FlightRing::get().dump(&stream);
+}
+catch (...) {
+}
+
+SSS_END;
@@ -0,0 +1,329 @@
+#include "Commons/logsink.hpp"
+#include <shared_mutex>
+
+SSS_BEGIN;
+
+Log::Sink::Sink(Level level, Flush flush) noexcept
+    : _level(level), _flush_policy(flush)
+{
+}
+
+Log::Sink::~Sink()
+{
+}
+
+void Log::Sink::write(Level level, std::string_view line, bool batch_end) noexcept try
+{
+    if (!accepts(level)) {
+        return;
+    }
+    std::unique_lock const lock(_mutex);
+    _write(level, line);
+    Flush const policy = getFlush();
+    if (policy == Flush::line
+        || (policy == Flush::batch && batch_end)
+        || (policy == Flush::error && level == Level::err))
+    {
+        _flush();
+        _dirty = false;
+    }
+    else {
+        _dirty = true;
+    }
+}
+catch (...) {
+}
+
+void Log::Sink::endBatch() noexcept try
+{
+    std::unique_lock const lock(_mutex);
+    if (_dirty && getFlush() == Flush::batch) {
+        _flush();
+        _dirty = false;
+    }
+}
+catch (...) {
+}
+
+void Log::Sink::flush() noexcept try
+{
+    std::unique_lock const lock(_mutex);
+    _flush();
+    _dirty = false;
+}
+catch (...) {
+}
+
+// Size above which console buffers are written regardless of policy
+static constexpr std::size_t _console_buffer_size = 1 << 16;
+
+Log::ConsoleSink::ConsoleSink(Level level, Flush flush) noexcept
+    : Sink(level, flush)
+{
+}
+
+Log::ConsoleSink::~ConsoleSink()
+{
+    _flush();
+}
+
+void Log::ConsoleSink::_write(Level level, std::string_view line)
+{
+    bool const err = level != Level::msg;
+    _buffer += line;
+    if (_runs.empty() || _runs.back().err != err) {
+        _runs.push_back({ err, _buffer.size() });
+    }
+    else {
+        _runs.back().end = _buffer.size();
+    }
+    if (_buffer.size() >= _console_buffer_size) {
+        _flush();
+    }
+}
+
+void Log::ConsoleSink::_flush()
+{
+    // Keeps the order of lines across both streams
+    std::size_t begin = 0;
+    for (_Run const& run : _runs) {
+        (run.err ? std::cerr : std::cout).write(_buffer.data() + begin, run.end - begin).flush();
+        begin = run.end;
+    }
+    _buffer.clear();
+    _runs.clear();
+}
+
+Log::FileSink::FileSink(std::filesystem::path path, bool append, std::size_t buffer_size)
+    : _path(std::move(path)), _buffer_size(buffer_size)
+{
+    _buffer.reserve(_buffer_size);
+    _open(append);
+}
+
+Log::FileSink::~FileSink()
+{
+    _close();
+}
+
+void Log::FileSink::_write(Level, std::string_view line)
+{
+    if (_buffer.size() + line.size() > _buffer_size) {
+        _flush();
+    }
+    _buffer += line;
+    _size += line.size();
+}
+
+void Log::FileSink::_flush()
+{
+    if (!_buffer.empty()) {
+        _file.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _buffer.clear();
+    }
+    _file.flush();
+}
+
+void Log::FileSink::_open(bool append)
+{
+    _file.open(_path, std::ios::out | std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+    if (!_file.is_open()) {
+        throw_exc("Could not open log file '" + _path.string() + "'");
+    }
+    std::error_code ec;
+    std::uintmax_t const size = append ? std::filesystem::file_size(_path, ec) : 0;
+    _size = ec ? 0 : size;
+}
+
+void Log::FileSink::_close()
+{
+    if (_file.is_open()) {
+        _flush();
+        _file.close();
+    }
+}
+
+Log::RotatingFileSink::RotatingFileSink(std::filesystem::path path, std::uintmax_t max_size,
+    std::chrono::seconds max_age, std::size_t max_files)
+    : FileSink(std::move(path)), _max_size(max_size), _max_age(max_age),
+    _max_files(max_files), _opened_at(std::chrono::steady_clock::now())
+{
+}
+
+void Log::RotatingFileSink::_write(Level level, std::string_view line)
+{
+    if (_fileSize() != 0 && (
+        (_max_size != 0 && _fileSize() + line.size() > _max_size)
+        || (_max_age.count() != 0 && std::chrono::steady_clock::now() - _opened_at >= _max_age)))
+    {
+        _rotate();
+    }
+    FileSink::_write(level, line);
+}
+
+// Returns "dir/name.{index}.ext"
+static std::filesystem::path _rotatedPath(std::filesystem::path const& path, std::size_t index)
+{
+    std::filesystem::path ret = path;
+    ret.replace_filename(path.stem().string() + '.' + std::to_string(index) + path.extension().string());
+    return ret;
+}
+
+void Log::RotatingFileSink::_rotate()
+{
+    _close();
+    std::error_code ec;
+    if (_max_files == 0) {
+        std::filesystem::remove(getPath(), ec);
+    }
+    else {
+        std::filesystem::remove(_rotatedPath(getPath(), _max_files), ec);
+        for (std::size_t i = _max_files - 1; i != 0; --i) {
+            std::filesystem::rename(_rotatedPath(getPath(), i), _rotatedPath(getPath(), i + 1), ec);
+        }
+        std::filesystem::rename(getPath(), _rotatedPath(getPath(), 1), ec);
+    }
+    _open(false);
+    _opened_at = std::chrono::steady_clock::now();
+}
+
+Log::CallbackSink::CallbackSink(Callback callback, Level level, Flush flush)
+    : Sink(level, flush), _callback(std::move(callback))
+{
+}
+
+void Log::CallbackSink::_write(Level level, std::string_view line)
+{
+    if (_callback) {
+        _callback(level, line);
+    }
+}
+
+// Registered sinks, the console one included by default
+struct _SinkList {
+    static _SinkList& get() {
+        static _SinkList instance;
+        return instance;
+    };
+
+    std::shared_ptr<Log::ConsoleSink> const console{ std::make_shared<Log::ConsoleSink>() };
+    std::shared_mutex mutex;
+    std::vector<std::shared_ptr<Log::Sink>> sinks{ console };
+};
+
+void Log::addSink(std::shared_ptr<Sink> sink)
+{
+    if (!sink) {
+        return;
+    }
+    _SinkList& list = _SinkList::get();
+    std::unique_lock const lock(list.mutex);
+    if (std::find(list.sinks.cbegin(), list.sinks.cend(), sink) == list.sinks.cend()) {
+        list.sinks.emplace_back(std::move(sink));
+    }
+}
+
+void Log::removeSink(std::shared_ptr<Sink> const& sink)
+{
+    _SinkList& list = _SinkList::get();
+    {
+        std::unique_lock const lock(list.mutex);
+        std::erase(list.sinks, sink);
+    }
+    if (sink) {
+        sink->flush();
+    }
+}
+
+void Log::clearSinks()
+{
+    _SinkList& list = _SinkList::get();
+    std::vector<std::shared_ptr<Sink>> removed;
+    {
+        std::unique_lock const lock(list.mutex);
+        removed.swap(list.sinks);
+    }
+    for (std::shared_ptr<Sink> const& sink : removed) {
+        sink->flush();
+    }
+}
+
+std::shared_ptr<Log::ConsoleSink> const& Log::consoleSink() noexcept
+{
+    return _SinkList::get().console;
+}
+
+// Sinks aren't re-entrant: lines logged from within a sink (e.g. by
+// a callback) are deferred until the dispatch in progress on this thread
+// returns. Lines logged while dispatching deferred ones are dropped, so
+// that a sink logging each line it writes can't loop forever.
+static thread_local bool _dispatching = false;
+static thread_local bool _redispatching = false;
+static thread_local std::vector<std::pair<Log::Level, std::string>> _deferred_lines;
+
+static void _dispatch(Log::Level level, std::string_view line, bool batch_end) noexcept try
+{
+    _SinkList& list = _SinkList::get();
+    std::shared_lock const lock(list.mutex);
+    for (std::shared_ptr<Log::Sink> const& sink : list.sinks) {
+        sink->write(level, line, batch_end);
+    }
+}
+catch (...) {
+}
+
+void Log::_internal::dispatch(Level level, std::string_view line, bool batch_end) noexcept try
+{
+    if (_dispatching) {
+        if (!_redispatching) {
+            _deferred_lines.emplace_back(level, line);
+        }
+        return;
+    }
+    _dispatching = true;
+    _dispatch(level, line, batch_end);
+    if (!_deferred_lines.empty()) {
+        _redispatching = true;
+        std::vector<std::pair<Level, std::string>> lines;
+        lines.swap(_deferred_lines);
+        for (auto const& [deferred_level, deferred_line] : lines) {
+            _dispatch(deferred_level, deferred_line, batch_end);
+        }
+        _redispatching = false;
+    }
+    _dispatching = false;
+}
+catch (...) {
+    _deferred_lines.clear();
+    _redispatching = false;
+    _dispatching = false;
+}
+
+bool Log::_internal::isDispatching() noexcept
+{
+    return _dispatching;
+}
+
+void Log::_internal::endBatch() noexcept try
+{
+    _SinkList& list = _SinkList::get();
+    std::shared_lock const lock(list.mutex);
+    for (std::shared_ptr<Sink> const& sink : list.sinks) {
+        sink->endBatch();
+    }
+}
+catch (...) {
+}
+
+void Log::_internal::flushSinks() noexcept try
+{
+    _SinkList& list = _SinkList::get();
+    std::shared_lock const lock(list.mutex);
+    for (std::shared_ptr<Sink> const& sink : list.sinks) {
+        sink->flush();
+    }
+}
+catch (...) {
+}
+
+SSS_END;
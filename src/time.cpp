@@ -21,7 +21,47 @@ void sleepUntil(steady_clock::time_point time)
 // Returns a formatted string displaying the current UTF time
 std::string timeUTF()
 {
-    return convertTime(system_clock::now().time_since_epoch());
+    return std::string(cachedTimeUTF(system_clock::now()));
+}
+
+// Writes the given value in the given buffer as N zero-padded digits
+template <int N>
+static void _writeDigits(char* buff, long long value) noexcept
+{
+    for (int i = N - 1; i >= 0; --i) {
+        buff[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// Formats the given time, re-using the "hh:mm:ss." prefix within a second
+std::string_view cachedTimeUTF(system_clock::time_point time) noexcept
+{
+    thread_local long long cached_sec = -1;
+    thread_local char buff[12];
+
+    long long const ms = duration_cast<milliseconds>(time.time_since_epoch()).count();
+    long long const sec = ms / 1000;
+    if (sec != cached_sec) {
+        _writeDigits<2>(buff, (sec / 3600) % 24);
+        buff[2] = ':';
+        _writeDigits<2>(buff + 3, (sec / 60) % 60);
+        buff[5] = ':';
+        _writeDigits<2>(buff + 6, sec % 60);
+        buff[8] = '.';
+        cached_sec = sec;
+    }
+    _writeDigits<3>(buff + 9, ms % 1000);
+    return std::string_view(buff, sizeof(buff));
+}
+
+// Converts a steady_clock stamp to system_clock, using an offset computed once
+system_clock::time_point monotonicToSystem(long long ns) noexcept
+{
+    static system_clock::duration const offset =
+        system_clock::now().time_since_epoch()
+        - duration_cast<system_clock::duration>(steady_clock::now().time_since_epoch());
+    return system_clock::time_point(offset + duration_cast<system_clock::duration>(nanoseconds(ns)));
 }
 
 long long Stopwatch::getMS() const
@@ -58,8 +98,9 @@ bool FrameTimer::addFrame() noexcept
     ++_frames;
 
     // Update current longest frame
-    long long const frame_ms = _frame_watch.getMS();
+    _last_frame = _frame_watch.getPreciseMS();
     _frame_watch.reset();
+    long long const frame_ms = static_cast<long long>(_last_frame);
     if (frame_ms > _current_longest_frame) {
         _current_longest_frame = frame_ms;
     }
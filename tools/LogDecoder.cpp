@@ -0,0 +1,21 @@
+// Converts binary log files written via SSS::Log::Binary back to text.
+// Build as a console application linked against SSS/Commons, eg:
+//      cl /std:c++20 /EHsc /I..\inc LogDecoder.cpp Commons.lib
+// Usage:
+//      LogDecoder <file> [--threads]
+#include "Commons/binlog.hpp"
+
+int main(int argc, char** argv) try
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <file> [--threads]" << std::endl;
+        return 1;
+    }
+    bool const thread_ids = argc > 2 && std::string(argv[2]) == "--threads";
+    SSS::Log::Binary::decode(argv[1], std::cout, thread_ids);
+    return 0;
+}
+catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+}